@@ -0,0 +1,102 @@
+// Running aggregates from aggregate.cpp against values worked out by hand, and
+// the rules around them: support PIDs are not aggregated, a report resets the
+// window.
+//
+//   make check
+
+#include "aggregate.h"
+#include "obd_poller.h"
+
+#include <math.h>
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK_NEAR(value, expected) CHECK(fabs((value) - (expected)) < 1e-3)
+
+void debug_print(String msg) {
+    (void)msg;
+}
+
+static void testStatistics() {
+    aggregateResetAll();
+    for (unsigned i=1; i<=5; i++) aggregateSample(ENGINE_RPM, i);
+
+    const PidAggregate &aggregate = aggregates[ENGINE_RPM];
+    CHECK(aggregate.count == 5);
+    CHECK_NEAR(aggregate.min, 1);
+    CHECK_NEAR(aggregate.max, 5);
+    CHECK_NEAR(aggregate.mean, 3);
+    CHECK_NEAR(aggregateStddev(aggregate), sqrt(2.5));
+}
+
+// min / max come from the first sample, not the zeroed window
+static void testNegativeValues() {
+    aggregateResetAll();
+    aggregateSample(AMBIENT_AIR_TEMPERATURE, -12);
+    aggregateSample(AMBIENT_AIR_TEMPERATURE, -4);
+
+    const PidAggregate &aggregate = aggregates[AMBIENT_AIR_TEMPERATURE];
+    CHECK_NEAR(aggregate.min, -12);
+    CHECK_NEAR(aggregate.max, -4);
+    CHECK_NEAR(aggregate.mean, -8);
+}
+
+// Small spread on a large value, where the naive sum of squares loses it
+static void testLargeOffset() {
+    aggregateResetAll();
+    const float values[] = {10004, 10007, 10013, 10016};
+    for (unsigned i=0; i<4; i++) aggregateSample(RUN_TIME_SINCE_ENGINE_START, values[i]);
+
+    const PidAggregate &aggregate = aggregates[RUN_TIME_SINCE_ENGINE_START];
+    CHECK_NEAR(aggregate.mean, 10010);
+    CHECK_NEAR(aggregateStddev(aggregate), sqrt(30.0));
+}
+
+static void testSingleSampleAndReset() {
+    aggregateResetAll();
+    aggregateSample(VEHICLE_SPEED, 42);
+    CHECK(aggregates[VEHICLE_SPEED].count == 1);
+    CHECK(aggregateStddev(aggregates[VEHICLE_SPEED]) == 0);
+
+    aggregateResetAll();
+    CHECK(aggregates[VEHICLE_SPEED].count == 0);
+    CHECK(aggregates[VEHICLE_SPEED].mean == 0);
+    CHECK(aggregates[VEHICLE_SPEED].m2 == 0);
+}
+
+// Support bitmaps are stored but never aggregated
+static void testSupportPidsSkipped() {
+    resetOBDSupportData();
+    aggregateResetAll();
+    aggregate_mode = true;
+
+    storeMessageValue(PIDS_SUPPORT_01_20, 0x98180000, 0x98180000);
+    storeMessageValue(ENGINE_RPM, 2000, 8000);
+    CHECK(aggregates[PIDS_SUPPORT_01_20].count == 0);
+    CHECK(aggregates[ENGINE_RPM].count == 1);
+
+    aggregate_mode = false;
+}
+
+int main() {
+    testStatistics();
+    testNegativeValues();
+    testLargeOffset();
+    testSingleSampleAndReset();
+    testSupportPidsSkipped();
+
+    if (failures) {
+        fprintf(stderr, "%d failed\n", failures);
+        return 1;
+    }
+    printf("aggregate_test: ok\n");
+    return 0;
+}
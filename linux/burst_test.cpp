@@ -0,0 +1,144 @@
+// Burst capture cases around burst.cpp: a window larger than the buffer is
+// split between pre and post in proportion to their times and marked "tc",
+// one that fits is sent whole, and "bit" triggers look at the raw data bytes.
+//
+//   make check
+
+#include "burst.h"
+#include "obd2.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+void debug_print(String msg) {
+    (void)msg;
+}
+
+static bool configure(const char *config) {
+    DynamicJsonDocument json(1024);
+    deserializeJson(json, config);
+    return burstConfigure(json.as<JsonObject>());
+}
+
+struct BurstResult {
+    unsigned lines;
+    unsigned pre;       // samples before the trigger, value 0
+    unsigned post;      // samples after it, value 1
+    bool truncated;
+};
+
+// Waits out the post-trigger time and collects every line of the burst
+static BurstResult drain(unsigned long post_ms) {
+
+    BurstResult result = {0, 0, 0, false};
+    usleep((post_ms + 20) * 1000);
+    burstLoop();
+
+    // Armed again once the last line is out, or still armed if nothing fired
+    String output;
+    for (;;) {
+        if (!burstNextChunk(output)) {
+            if (burstArmed()) break;
+            usleep(BURST_CHUNK_PERIOD_MS * 1000);
+            continue;
+        }
+        result.lines++;
+
+        DynamicJsonDocument json(8192);
+        CHECK(deserializeJson(json, output.c_str()) == DeserializationError::Ok);
+        if (!json["bu"]["tc"].isNull()) result.truncated = true;
+        for (unsigned i=0; i<json["bu"]["s"].size(); i++) {
+            float value = json["bu"]["s"][i][2] | -1.0f;
+            if (value == 0) result.pre++;
+            else if (value == 1) result.post++;
+        }
+    }
+    return result;
+}
+
+// 700 samples either side of the trigger with pre = post: 300 of each are kept
+static void testSplitOverflow() {
+    CHECK(configure("{\"pids\":[12],\"pre\":1,\"post\":1,\"trig\":[{\"pid\":13,\"op\":\">\",\"v\":50}]}"));
+
+    for (unsigned i=0; i<700; i++) burstSample(ENGINE_RPM, 0, 0);
+    burstSample(VEHICLE_SPEED, 100, 100);
+    for (unsigned i=0; i<700; i++) burstSample(ENGINE_RPM, 1, 1);
+
+    BurstResult result = drain(1000);
+    CHECK(result.pre == BURST_MAX_SAMPLES / 2);
+    CHECK(result.post == BURST_MAX_SAMPLES / 2);
+    CHECK(result.truncated);
+}
+
+// A window that fits is sent whole and not marked truncated
+static void testWindowFits() {
+    CHECK(configure("{\"pids\":[12],\"pre\":1,\"post\":0,\"trig\":[{\"pid\":13,\"op\":\">\",\"v\":50}]}"));
+
+    for (unsigned i=0; i<10; i++) burstSample(ENGINE_RPM, 0, 0);
+    burstSample(VEHICLE_SPEED, 100, 100);
+    for (unsigned i=0; i<10; i++) burstSample(ENGINE_RPM, 1, 1);
+
+    BurstResult result = drain(0);
+    CHECK(result.lines == 1);
+    CHECK(result.pre == 10);
+    CHECK(result.post == 10);
+    CHECK(!result.truncated);
+}
+
+// A low bit of PID 1 with the MIL on: both words are the same float, only the
+// raw bytes tell them apart
+static void testBitTrigger() {
+    CHECK(configure("{\"pids\":[12],\"pre\":1,\"post\":0,\"trig\":[{\"pid\":1,\"op\":\"bit\",\"v\":2}]}"));
+
+    burstSample(ENGINE_RPM, 0, 0);
+    burstSample(MONITOR_STATUS_SINCE_DTCS_CLEARED, 0x83076500, 0x83076500);
+    CHECK(drain(0).lines == 0);
+
+    burstSample(MONITOR_STATUS_SINCE_DTCS_CLEARED, 0x83076504, 0x83076504);
+    BurstResult result = drain(0);
+    CHECK(result.lines == 1);
+    CHECK(result.pre == 1);
+}
+
+// Set bit on the first sample only: there is no 0 -> 1 transition to fire on
+static void testBitAlreadySet() {
+    CHECK(configure("{\"pids\":[12],\"pre\":1,\"post\":0,\"trig\":[{\"pid\":1,\"op\":\"bit\",\"v\":31}]}"));
+
+    burstSample(MONITOR_STATUS_SINCE_DTCS_CLEARED, 0x83076504, 0x83076504);
+    burstSample(MONITOR_STATUS_SINCE_DTCS_CLEARED, 0x83076504, 0x83076504);
+    CHECK(drain(0).lines == 0);
+}
+
+static void testInvalidConfig() {
+    CHECK(!configure("{\"pids\":[12],\"pre\":-1,\"trig\":[{\"pid\":13,\"op\":\">\",\"v\":50}]}"));
+    CHECK(!configure("{\"pids\":[12],\"post\":-5,\"trig\":[{\"pid\":13,\"op\":\">\",\"v\":50}]}"));
+    CHECK(!configure("{\"pids\":[12],\"trig\":[{\"pid\":13,\"op\":\"~\",\"v\":50}]}"));
+    CHECK(!burstArmed());
+
+    CHECK(configure("{\"trig\":[]}"));
+    CHECK(!burstArmed());
+}
+
+int main() {
+    testSplitOverflow();
+    testWindowFits();
+    testBitTrigger();
+    testBitAlreadySet();
+    testInvalidConfig();
+
+    if (failures) {
+        fprintf(stderr, "%d failed\n", failures);
+        return 1;
+    }
+    printf("burst_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,178 @@
+// carloop-decode: offline decoder for candump and Serial4 captures
+//
+//   carloop-decode -o out drive.log                  # pid_0c.csv, pid_0d.csv, ... in out/
+//   carloop-decode -f bin -d signals.json -o out drive.log
+//   carloop-decode -b [-n 512]                       # throughput on a synthetic capture
+
+#include "log_decoder.h"
+#include "signal_db.h"
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+
+#define BENCHMARK_RUNS 3
+
+static bool verbose = false;
+
+void debug_print(String msg) {
+    if (verbose) fprintf(stderr, "%s\n", msg.c_str());
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "usage: %s [-o <dir>] [-f csv|bin] [-d signals.json] [-j threads] [-v] <capture>\n"
+        "       %s -b [-n MB] [-d signals.json] [-j threads] [<capture>]\n"
+        "  -o  output directory, one file per PID / signal (default .)\n"
+        "  -f  csv (time,value rows) or bin (DecodeFileHeader, times, values)\n"
+        "  -d  signal database for broadcast frames (the \"sig\" object of signals.h)\n"
+        "  -j  decode threads (default: all cores)\n"
+        "  -b  decode only, best of %d runs, and print frames/s and GB/s\n"
+        "  -n  size of the synthetic candump capture for -b without a file (default 256)\n"
+        "  -v  debug output on stderr\n", argv0, argv0, BENCHMARK_RUNS);
+}
+
+static double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Engine ECU replies at 100 Hz plus the simulated ECU's broadcast frames (sim-signals.json)
+static std::string syntheticCapture(size_t megabytes) {
+    static const uint8_t PIDS[] = {ENGINE_RPM, VEHICLE_SPEED, ENGINE_COOLANT_TEMPERATURE, THROTTLE_POSITION};
+
+    std::string capture;
+    capture.reserve(megabytes << 20);
+
+    char line[96];
+    for (unsigned long i=0; capture.size() < megabytes << 20; i++) {
+        unsigned long long us = 1697040000000000ULL + i * 10000ULL;
+        if (i % 2) {
+            uint8_t pid = PIDS[(i / 2) % sizeof(PIDS)];
+            snprintf(line, sizeof(line), "(%llu.%06llu) can0 7E8#0441%02X%02X%02XAAAAAA\n",
+                us / 1000000, us % 1000000, pid, (unsigned)(i * 7) & 0xFF, (unsigned)(i * 13) & 0xFF);
+        } else {
+            snprintf(line, sizeof(line), "(%llu.%06llu) can0 201#%04X0000%04X%02X00\n",
+                us / 1000000, us % 1000000, (unsigned)(i * 4) & 0xFFFF, (unsigned)(i % 16000), (unsigned)(i % 200));
+        }
+        capture += line;
+    }
+    return capture;
+}
+
+static bool benchmark(const char *data, size_t size, unsigned threads) {
+
+    double best = 0;
+    unsigned long frames = 0;
+    for (unsigned run=0; run<BENCHMARK_RUNS; run++) {
+        LogDecoder decoder(data, size, threads);
+        double start = nowSeconds();
+        if (!decoder.run()) return false;
+        double elapsed = nowSeconds() - start;
+        if (run == 0 || elapsed < best) best = elapsed;
+        frames = decoder.frames();
+    }
+
+    printf("input          %.1f MB, %lu frames, %u threads\n", size / 1e6, frames, threads);
+    printf("decode         %.3f s\n", best);
+    printf("throughput     %.0f frames/s  %.2f GB/s\n", frames / best, size / best / 1e9);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *directory = ".";
+    const char *signals_path = NULL;
+    bool binary = false;
+    bool bench = false;
+    size_t bench_megabytes = 256;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:f:d:j:bn:vh")) != -1) {
+        switch (opt) {
+            case 'o': directory = optarg; break;
+            case 'f':
+                if (strcmp(optarg, "csv") && strcmp(optarg, "bin")) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                binary = !strcmp(optarg, "bin");
+                break;
+            case 'd': signals_path = optarg; break;
+            case 'j': threads = atoi(optarg); break;
+            case 'b': bench = true; break;
+            case 'n': bench_megabytes = atoi(optarg); break;
+            case 'v': verbose = true; break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (threads < 1) threads = 1;
+    if (optind + 1 < argc || (!bench && optind == argc)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    signalsClear();
+    if (signals_path && !loadSignalDatabase(signals_path)) {
+        fprintf(stderr, "invalid signal database: %s\n", signals_path);
+        return 2;
+    }
+
+    if (bench && optind == argc) {
+        std::string capture = syntheticCapture(bench_megabytes);
+        return benchmark(capture.data(), capture.size(), threads) ? 0 : 1;
+    }
+
+    const char *path = argv[optind];
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        fprintf(stderr, "%s: empty or unreadable\n", path);
+        close(fd);
+        return 1;
+    }
+
+    const char *data = (const char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+
+    if (bench) {
+        bool ok = benchmark(data, st.st_size, threads);
+        munmap((void *)data, st.st_size);
+        return ok ? 0 : 1;
+    }
+
+    if (mkdir(directory, 0755) < 0 && errno != EEXIST) {
+        perror(directory);
+        return 1;
+    }
+
+    LogDecoder decoder(data, st.st_size, threads);
+    double start = nowSeconds();
+    bool ok = decoder.run() && decoder.write(directory, binary);
+    double elapsed = nowSeconds() - start;
+
+    fprintf(stderr, "%s: %s, %lu lines, %lu frames, %lu samples, %lu lines not decoded in %.2f s\n", path,
+        decoder.format() == LOG_CANDUMP ? "candump" : "Serial4", decoder.lines(), decoder.frames(), decoder.samples(),
+        decoder.failures(), elapsed);
+    for (unsigned column=0; column<DECODE_COLUMNS; column++) {
+        size_t count = decoder.columnSize(column);
+        if (count) fprintf(stderr, "  %-48s %zu\n", columnName(column).c_str(), count);
+    }
+
+    munmap((void *)data, st.st_size);
+    return ok ? 0 : 1;
+}
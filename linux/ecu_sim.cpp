@@ -0,0 +1,282 @@
+#include "ecu_sim.h"
+#include "obd_poller.h"
+
+#include <poll.h>
+#include <unistd.h>
+
+static const uint8_t SIM_PIDS[] = {
+    CALCULATED_ENGINE_LOAD,
+    ENGINE_COOLANT_TEMPERATURE,
+    ENGINE_RPM,
+    VEHICLE_SPEED,
+    AIR_INTAKE_TEMPERATURE,
+    THROTTLE_POSITION,
+    RUN_TIME_SINCE_ENGINE_START,
+    PIDS_SUPPORT_21_40,
+    FUEL_TANK_LEVEL_INPUT,
+    PIDS_SUPPORT_41_60,
+    CONTROL_MODULE_VOLTAGE,
+    AMBIENT_AIR_TEMPERATURE,
+    ENGINE_OIL_TEMPERATURE,
+};
+
+EcuSim::EcuSim(SocketCan &can, unsigned reply_delay_us)
+    : can_(can), reply_delay_us_(reply_delay_us), running_(false), answered_(0), pushed_(0), extended_session_(false), broadcast_sent_ms_(0) {
+    memset(define_frame_, 0, sizeof(define_frame_));
+    memset(periodic_pid_, 0, sizeof(periodic_pid_));
+    memset(periodic_len_, 0, sizeof(periodic_len_));
+    memset(periodic_rate_, 0, sizeof(periodic_rate_));
+    memset(periodic_sent_ms_, 0, sizeof(periodic_sent_ms_));
+}
+
+bool EcuSim::start() {
+    canid_t request_id = obd_request_id | (obd_extended ? CAN_EFF_FLAG : 0);
+    can_.setReceiveFilter(&request_id, 1);
+
+    running_ = true;
+    if (pthread_create(&thread_, NULL, threadMain, this) != 0) {
+        running_ = false;
+        return false;
+    }
+    return true;
+}
+
+void EcuSim::stop() {
+    if (!running_) return;
+    running_ = false;
+    pthread_join(thread_, NULL);
+}
+
+void *EcuSim::threadMain(void *arg) {
+    static_cast<EcuSim *>(arg)->serve();
+    return NULL;
+}
+
+bool EcuSim::supports(uint8_t pid) const {
+    for (unsigned i=0; i<sizeof(SIM_PIDS); i++) {
+        if (SIM_PIDS[i] == pid) return true;
+    }
+    return false;
+}
+
+void EcuSim::fillValue(uint8_t pid, uint8_t value[4]) {
+
+    // Support bitmaps: bit 31 is PID shift+1, bit 0 is PID shift+0x20
+    if (pid == PIDS_SUPPORT_01_20 || pid == PIDS_SUPPORT_21_40 || pid == PIDS_SUPPORT_41_60) {
+        uint32_t mask = 0;
+        for (unsigned i=0; i<sizeof(SIM_PIDS); i++) {
+            if (SIM_PIDS[i] > pid && SIM_PIDS[i] <= pid + 0x20) mask |= 1UL << (0x20 - (SIM_PIDS[i] - pid));
+        }
+        value[0] = mask >> 24;
+        value[1] = mask >> 16;
+        value[2] = mask >> 8;
+        value[3] = mask;
+        return;
+    }
+
+    // Slowly varying values so consumers see something move
+    unsigned long t = millis() / 100;
+    unsigned rpm = (800 + (t * 37) % 5200) * 4;
+    value[0] = 0;
+    value[1] = 0;
+    value[2] = 0;
+    value[3] = 0;
+
+    switch (pid) {
+        case ENGINE_RPM:
+            value[0] = rpm >> 8;
+            value[1] = rpm;
+            break;
+        case VEHICLE_SPEED:
+            value[0] = (t * 3) % 160;
+            break;
+        case CONTROL_MODULE_VOLTAGE:
+            value[0] = 14100 >> 8;
+            value[1] = 14100 & 0xFF;
+            break;
+        case RUN_TIME_SINCE_ENGINE_START:
+            value[0] = (t / 10) >> 8;
+            value[1] = t / 10;
+            break;
+        default:
+            value[0] = 40 + (t + pid) % 100;
+            break;
+    }
+}
+
+bool EcuSim::sendReply(const uint8_t data[8]) {
+    struct can_frame reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.can_id = obd_reply_id | (obd_extended ? CAN_EFF_FLAG : 0);
+    reply.can_dlc = 8;
+    memcpy(reply.data, data, 8);
+    return can_.transmit(reply);
+}
+
+static void negativeResponse(uint8_t data[8], uint8_t service, uint8_t code) {
+    data[0] = 0x03;
+    data[1] = 0x7F;
+    data[2] = service;
+    data[3] = code;
+}
+
+// The UDS subset used by periodic.cpp: 10, 2C 01 (two frames), 2A and 3E
+bool EcuSim::handleUdsRequest(const uint8_t request[8], uint8_t reply[8]) {
+
+    // 2C 01 first frame: remember it and ask for the rest
+    if ((request[0] & 0xF0) == 0x10 && request[2] == 0x2C) {
+        memcpy(define_frame_, request, 8);
+        reply[0] = 0x30;
+        return true;
+    }
+
+    if (request[0] == 0x21 && define_frame_[2] == 0x2C) {
+        uint8_t pdid = define_frame_[5];
+        uint8_t pid = define_frame_[7];
+        define_frame_[2] = 0;
+        if (!extended_session_ || define_frame_[4] != 0xF2 || define_frame_[6] != 0xF4 || !supports(pid)) {
+            negativeResponse(reply, 0x2C, 0x31);
+            return true;
+        }
+        periodic_pid_[pdid] = pid;
+        periodic_len_[pdid] = request[2];
+        reply[0] = 0x04;
+        reply[1] = 0x6C;
+        reply[2] = 0x01;
+        reply[3] = 0xF2;
+        reply[4] = pdid;
+        return true;
+    }
+
+    switch (request[1]) {
+        case 0x10:
+            extended_session_ = request[2] == 0x03;
+            if (!extended_session_) memset(periodic_rate_, 0, sizeof(periodic_rate_));
+            reply[0] = 0x06;
+            reply[1] = 0x50;
+            reply[2] = request[2];
+            reply[4] = 0x32;
+            reply[5] = 0x01;
+            reply[6] = 0xF4;
+            return true;
+
+        case 0x2A: {
+            if (!extended_session_) {
+                negativeResponse(reply, 0x2A, 0x7F);
+                return true;
+            }
+            uint8_t rate = request[2];
+            for (unsigned i=3; i<(unsigned)request[0] + 1; i++) {
+                if (rate != 0x04 && !periodic_len_[request[i]]) {
+                    negativeResponse(reply, 0x2A, 0x31);
+                    return true;
+                }
+            }
+            for (unsigned i=3; i<(unsigned)request[0] + 1; i++) periodic_rate_[request[i]] = rate == 0x04 ? 0 : rate;
+            reply[0] = 0x01;
+            reply[1] = 0x6A;
+            return true;
+        }
+
+        // Positive response suppressed with 3E 80
+        case 0x3E:
+            if (request[2] & 0x80) return false;
+            reply[0] = 0x02;
+            reply[1] = 0x7E;
+            return true;
+    }
+    return false;
+}
+
+// Slow, medium and fast as 1 s, 200 ms and 25 ms
+void EcuSim::pushPeriodic() {
+    static const unsigned PERIOD_MS[] = {0, 1000, 200, 25};
+
+    unsigned long now = millis();
+    for (unsigned pdid=0; pdid<256; pdid++) {
+        uint8_t rate = periodic_rate_[pdid];
+        if (!rate || rate > 3 || now - periodic_sent_ms_[pdid] < PERIOD_MS[rate]) continue;
+        periodic_sent_ms_[pdid] = now;
+
+        uint8_t data[8] = {(uint8_t)pdid};
+        uint8_t value[4];
+        fillValue(periodic_pid_[pdid], value);
+        memcpy(&data[1], value, periodic_len_[pdid] < 4 ? periodic_len_[pdid] : 4);
+        if (sendReply(data)) pushed_++;
+    }
+}
+
+void EcuSim::pushBroadcast() {
+
+    unsigned long now = millis();
+    if (now - broadcast_sent_ms_ < 20) return;
+    broadcast_sent_ms_ = now;
+
+    uint8_t rpm[4];
+    uint8_t speed[4];
+    fillValue(ENGINE_RPM, rpm);
+    fillValue(VEHICLE_SPEED, speed);
+    unsigned speed_centi = speed[0] * 100;
+    int steering = (int)((now / 10) % 7200) - 3600;
+
+    struct can_frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.can_id = 0x201;
+    frame.can_dlc = 8;
+    frame.data[0] = rpm[0];
+    frame.data[1] = rpm[1];
+    frame.data[4] = speed_centi >> 8;
+    frame.data[5] = speed_centi;
+    frame.data[6] = (now / 50) % 200;
+    can_.transmit(frame);
+
+    memset(&frame, 0, sizeof(frame));
+    frame.can_id = 0x0D0;
+    frame.can_dlc = 8;
+    frame.data[0] = steering;
+    frame.data[1] = steering >> 8;
+    can_.transmit(frame);
+}
+
+bool EcuSim::pushing() const {
+    for (unsigned pdid=0; pdid<256; pdid++) {
+        if (periodic_rate_[pdid]) return true;
+    }
+    return false;
+}
+
+void EcuSim::serve() {
+    struct pollfd pfd;
+    pfd.fd = can_.fd();
+    pfd.events = POLLIN;
+
+    while (running_) {
+        int ready = poll(&pfd, 1, pushing() ? 5 : 20);
+        pushPeriodic();
+        pushBroadcast();
+        if (ready <= 0) continue;
+
+        struct can_frame request;
+        while (can_.receive(request)) {
+            if (request.can_dlc < 3) continue;
+
+            uint8_t reply[8] = {0};
+            // Mode 01 is always a two byte single frame; a 2C consecutive frame also starts 21 01
+            if (request.data[0] != 0x02 || request.data[1] != OBD_PID_SERVICE) {
+                if (handleUdsRequest(request.data, reply)) sendReply(reply);
+                continue;
+            }
+
+            uint8_t pid = request.data[2];
+            if (pid != PIDS_SUPPORT_01_20 && !supports(pid)) continue;
+
+            reply[0] = 0x06;
+            reply[1] = 0x40 | OBD_PID_SERVICE;
+            reply[2] = pid;
+            fillValue(pid, &reply[3]);
+
+            if (reply_delay_us_) usleep(reply_delay_us_);
+            if (sendReply(reply)) answered_++;
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include "socketcan.h"
+
+// Simulated engine ECU answering Mode 01 requests on obd_request_id with
+// obd_reply_id single frames, plus the UDS services behind periodic.h so its
+// supported PIDs can also be pushed. Also broadcasts two frames at 50 Hz like
+// a real powertrain bus, for signals.h:
+//   0x201  RPM * 4 (bytes 0-1, Motorola), speed * 100 (bytes 4-5, Motorola), pedal % * 2 (byte 6)
+//   0x0D0  steering angle * 10, signed (bytes 0-1, Intel)
+// Runs on its own thread so the gateway and load test can be exercised over a
+// loopback pair or a vcan interface.
+class EcuSim {
+public:
+    explicit EcuSim(SocketCan &can, unsigned reply_delay_us = 0);
+
+    bool start();
+    void stop();
+
+    unsigned long requestsAnswered() const { return answered_; }
+    unsigned long framesPushed() const { return pushed_; }
+
+private:
+    static void *threadMain(void *arg);
+    void serve();
+    bool supports(uint8_t pid) const;
+    void fillValue(uint8_t pid, uint8_t value[4]);
+    bool sendReply(const uint8_t data[8]);
+    bool handleUdsRequest(const uint8_t request[8], uint8_t reply[8]);
+    void pushPeriodic();
+    void pushBroadcast();
+    bool pushing() const;
+
+    SocketCan &can_;
+    unsigned reply_delay_us_;
+    volatile bool running_;
+    volatile unsigned long answered_;
+    volatile unsigned long pushed_;
+
+    // Periodic identifiers by PDID (0 = undefined / stopped)
+    bool extended_session_;
+    uint8_t define_frame_[8];
+    uint8_t periodic_pid_[256];
+    uint8_t periodic_len_[256];
+    uint8_t periodic_rate_[256];
+    unsigned long periodic_sent_ms_[256];
+    unsigned long broadcast_sent_ms_;
+    pthread_t thread_;
+};
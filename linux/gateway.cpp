@@ -0,0 +1,168 @@
+#include "gateway.h"
+#include "obd_poller.h"
+#include "subscription.h"
+#include "periodic.h"
+#include "signals.h"
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+Gateway::Gateway(SocketCan &can, OutputSink *output, const GatewayConfig &config)
+    : can_(can), output_(output), config_(config), awaiting_pid_(-1), request_sent_us_(0) {}
+
+void Gateway::setCanReady(bool ready) {
+
+    // Car is ready first time
+    if (ready && !can_ready) setReadSupportPIDsLoop(true);
+    can_ready = ready;
+}
+
+bool Gateway::transmit(const uint8_t data[8]) {
+
+    struct can_frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.can_id = obd_request_id | (obd_extended ? CAN_EFF_FLAG : 0);
+    frame.can_dlc = 8;
+    memcpy(frame.data, data, 8);
+
+    if (!can_.transmit(frame)) {
+        debug_print("Transmit failed: " + String(strerror(errno)));
+        return false;
+    }
+    return true;
+}
+
+void Gateway::sendRequest(unsigned long now_us) {
+
+    int request_pid = nextObdRequestPid();
+
+    uint8_t data[8];
+    buildObdRequest(data, request_pid);
+    if (!transmit(data)) return;
+
+    stats_.requests++;
+    awaiting_pid_ = request_pid;
+    request_sent_us_ = now_us;
+}
+
+void Gateway::receiveFrames(unsigned long now_us) {
+    struct can_frame frame;
+
+    while (can_.receive(frame)) {
+
+        if (frame.can_id & CAN_ERR_FLAG) {
+            setCanReady(false);
+            continue;
+        }
+
+        if (frame.can_id != (obd_reply_id | (obd_extended ? CAN_EFF_FLAG : 0))) {
+            bool extended = frame.can_id & CAN_EFF_FLAG;
+            signalsDecode(frame.can_id & (extended ? CAN_EFF_MASK : CAN_SFF_MASK), extended, frame.data, frame.can_dlc);
+            continue;
+        }
+
+        setCanReady(true);
+
+        if (periodicHandleFrame(frame.data)) continue;
+
+        if (!handleObdReply(awaiting_pid_, frame.data)) continue;
+
+        stats_.replies++;
+        if (config_.record_latency) stats_.latency_us.push_back(now_us - request_sent_us_);
+        awaiting_pid_ = -1;
+    }
+}
+
+bool Gateway::run(volatile sig_atomic_t *stop, unsigned long duration_ms) {
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        perror("epoll_create1");
+        return false;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = can_.fd();
+    epoll_ctl(epfd, EPOLL_CTL_ADD, can_.fd(), &ev);
+
+    if (output_ && output_->listenFd() >= 0) {
+        ev.data.fd = output_->listenFd();
+        epoll_ctl(epfd, EPOLL_CTL_ADD, output_->listenFd(), &ev);
+    }
+
+    // Reply id and the broadcast frames with signals, nothing else reaches userspace
+    canid_t filter_ids[SOCKETCAN_MAX_FILTERS];
+    uint32_t signal_ids[SOCKETCAN_MAX_FILTERS - 1];
+    bool signal_extended[SOCKETCAN_MAX_FILTERS - 1];
+    unsigned signal_id_count = signalIds(signal_ids, signal_extended, SOCKETCAN_MAX_FILTERS - 1);
+
+    filter_ids[0] = obd_reply_id | (obd_extended ? CAN_EFF_FLAG : 0);
+    for (unsigned i=0; i<signal_id_count; i++) filter_ids[i + 1] = signal_ids[i] | (signal_extended[i] ? CAN_EFF_FLAG : 0);
+    can_.setReceiveFilter(filter_ids, signal_id_count + 1);
+    setCanReady(true);
+
+    const unsigned long request_interval_us = config_.request_interval_ms * 1000UL;
+    const unsigned long reply_timeout_us = config_.reply_timeout_ms * 1000UL;
+    DEFAULT_SUBSCRIPTION.period_ms = config_.report_interval_ms;
+
+    unsigned long start_us = micros();
+    unsigned long next_request_us = start_us;
+
+    while (!(stop && *stop)) {
+
+        unsigned long now_us = micros();
+        if (duration_ms && now_us - start_us >= duration_ms * 1000UL) break;
+
+        setReadSupportPIDsLoop();
+
+        if (awaiting_pid_ >= 0 && now_us - request_sent_us_ >= reply_timeout_us) {
+            stats_.timeouts++;
+            awaiting_pid_ = -1;
+        }
+
+        uint8_t periodic_frame[8];
+        while (periodicNextFrame(periodic_frame)) transmit(periodic_frame);
+
+        if (awaiting_pid_ < 0 && !periodicBusy() && now_us >= next_request_us) {
+            sendRequest(now_us);
+            next_request_us = now_us + request_interval_us;
+        }
+
+        String line;
+        while (output_ && subscriptionNextReport(line)) {
+            output_->writeLine(line);
+            stats_.reports++;
+        }
+
+        // Sleep until the next reply, request slot or report
+        unsigned long wake_us = now_us + (output_ ? subscriptionNextDueMs() * 1000UL : 1000000UL);
+        if (awaiting_pid_ >= 0) {
+            if (request_sent_us_ + reply_timeout_us < wake_us) wake_us = request_sent_us_ + reply_timeout_us;
+        } else if (!periodicBusy() && next_request_us < wake_us) {
+            wake_us = next_request_us;
+        }
+        // Periodic negotiation timeouts and tester present
+        if (periodicRunning() && now_us + 20000 < wake_us) wake_us = now_us + 20000;
+        int timeout_ms = wake_us > now_us ? (int)((wake_us - now_us + 999) / 1000) : 0;
+
+        struct epoll_event events[4];
+        int n = epoll_wait(epfd, events, 4, timeout_ms);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        now_us = micros();
+        for (int i=0; i<n; i++) {
+            if (events[i].data.fd == can_.fd()) receiveFrames(now_us);
+            else if (output_) output_->acceptClients();
+        }
+    }
+
+    close(epfd);
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <signal.h>
+#include <vector>
+#include "socketcan.h"
+#include "output.h"
+
+struct GatewayConfig {
+    unsigned request_interval_ms = 100;  // same cadence as the Electron loop(); 0 = back-to-back
+    unsigned reply_timeout_ms = 50;      // same wait as getObdResponse()
+    unsigned report_interval_ms = 1000;
+    bool record_latency = false;
+};
+
+struct GatewayStats {
+    unsigned long requests = 0;
+    unsigned long replies = 0;
+    unsigned long timeouts = 0;
+    unsigned long reports = 0;
+    std::vector<unsigned> latency_us;
+};
+
+// epoll-driven equivalent of the Electron loop(): one outstanding OBD request
+// at a time through the shared obd_poller scheduling and decoding, with the
+// same JSON report written to an OutputSink.
+class Gateway {
+public:
+    Gateway(SocketCan &can, OutputSink *output, const GatewayConfig &config);
+
+    // Runs until *stop is set or duration_ms elapses (0 = forever)
+    bool run(volatile sig_atomic_t *stop, unsigned long duration_ms = 0);
+
+    const GatewayStats &stats() const { return stats_; }
+
+private:
+    bool transmit(const uint8_t data[8]);
+    void sendRequest(unsigned long now_us);
+    void receiveFrames(unsigned long now_us);
+    void setCanReady(bool ready);
+
+    SocketCan &can_;
+    OutputSink *output_;
+    GatewayConfig config_;
+    GatewayStats stats_;
+
+    int awaiting_pid_;
+    unsigned long request_sent_us_;
+};
@@ -0,0 +1,90 @@
+// carloop-loadtest: drive the gateway back-to-back against the simulated ECU and
+// report sustained request rate and request->reply latency
+//
+//   carloop-loadtest              # in-process loopback, 5 s
+//   carloop-loadtest -i vcan0 -d 30
+
+#include "gateway.h"
+#include "ecu_sim.h"
+#include "obd_poller.h"
+#include "subscription.h"
+
+#include <algorithm>
+#include <getopt.h>
+
+void debug_print(String msg) {}
+
+static unsigned percentile(const std::vector<unsigned> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+int main(int argc, char **argv) {
+    const char *ifname = NULL;
+    unsigned seconds = 5;
+    unsigned ecu_delay_us = 0;
+    static uint8_t pids[PID_SIZE];
+    unsigned pid_count = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:d:D:p:xh")) != -1) {
+        switch (opt) {
+            case 'i': ifname = optarg; break;
+            case 'd': seconds = atoi(optarg); break;
+            case 'D': ecu_delay_us = atoi(optarg); break;
+            case 'x':
+                obd_request_id = 0x18DA10F1;
+                obd_reply_id = 0x18DAF110;
+                obd_extended = true;
+                break;
+            case 'p':
+                for (char *tok = strtok(optarg, ","); tok && pid_count < PID_SIZE; tok = strtok(NULL, ",")) {
+                    pids[pid_count++] = strtol(tok, NULL, 0);
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-i <ifname>] [-d seconds] [-D ecu_delay_us] [-p pid,pid,...] [-x]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    resetOBDSupportData();
+    if (pid_count) setDefaultSubscription(false, pids, pid_count);
+
+    SocketCan can;
+    SocketCan ecu_can;
+    if (ifname) {
+        if (!can.open(ifname) || !ecu_can.open(ifname)) return 1;
+    } else {
+        int fds[2];
+        if (!socketCanLoopbackPair(fds)) return 1;
+        can.openLoopback(fds[0]);
+        ecu_can.openLoopback(fds[1]);
+    }
+
+    EcuSim ecu(ecu_can, ecu_delay_us);
+    if (!ecu.start()) return 1;
+
+    GatewayConfig config;
+    config.request_interval_ms = 0;
+    config.record_latency = true;
+
+    Gateway gateway(can, NULL, config);
+    gateway.run(NULL, seconds * 1000UL);
+    ecu.stop();
+
+    GatewayStats stats = gateway.stats();
+    std::sort(stats.latency_us.begin(), stats.latency_us.end());
+
+    printf("transport      %s\n", ifname ? ifname : "loopback");
+    printf("duration       %u s\n", seconds);
+    printf("requests       %lu (%.0f/s)\n", stats.requests, stats.requests / (double)seconds);
+    printf("replies        %lu (%.0f/s)\n", stats.replies, stats.replies / (double)seconds);
+    printf("timeouts       %lu\n", stats.timeouts);
+    printf("latency us     p50 %u  p90 %u  p99 %u  max %u\n",
+        percentile(stats.latency_us, 0.50), percentile(stats.latency_us, 0.90),
+        percentile(stats.latency_us, 0.99), stats.latency_us.empty() ? 0 : stats.latency_us.back());
+
+    return stats.replies > 0 ? 0 : 1;
+}
@@ -0,0 +1,413 @@
+#include "log_decoder.h"
+#include "obd_poller.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// "1697040000.123456" without strtod: lines in the mapping are not terminated
+static const char *parseSeconds(const char *p, const char *end, double &seconds) {
+    const char *start = p;
+    uint64_t whole = 0;
+    while (p < end && *p >= '0' && *p <= '9') whole = whole * 10 + (*p++ - '0');
+    if (p == start) return NULL;
+
+    uint64_t fraction = 0;
+    uint64_t scale = 1;
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9' && scale < 1000000000ULL) {
+            fraction = fraction * 10 + (*p++ - '0');
+            scale *= 10;
+        }
+        while (p < end && *p >= '0' && *p <= '9') p++;
+    }
+
+    seconds = whole + (double)fraction / scale;
+    return p;
+}
+
+// "(1697040000.123456) can0 7E8#06410C1AF8AAAAAA", 3 hex digits for 11-bit ids, 8 for 29-bit
+static bool parseCandump(const char *p, const char *end, double &time, uint32_t &id, bool &extended, uint8_t data[8], uint8_t &len) {
+
+    if (p == end || *p++ != '(') return false;
+    p = parseSeconds(p, end, time);
+    if (!p || p == end || *p++ != ')') return false;
+
+    // Interface name
+    while (p < end && *p == ' ') p++;
+    while (p < end && *p != ' ') p++;
+    while (p < end && *p == ' ') p++;
+
+    const char *id_start = p;
+    id = 0;
+    int digit;
+    while (p < end && (digit = hexValue(*p)) >= 0) {
+        id = (id << 4) | digit;
+        p++;
+    }
+    if (p == end || *p != '#' || p == id_start) return false;
+    extended = p - id_start > 3;
+    p++;
+
+    // Remote frames ("R") and CAN FD ("##") carry no OBD data
+    len = 0;
+    while (p + 1 < end && len < 8) {
+        int high = hexValue(p[0]);
+        int low = hexValue(p[1]);
+        if (high < 0 || low < 0) break;
+        data[len++] = (high << 4) | low;
+        p += 2;
+    }
+    for (unsigned i=len; i<8; i++) data[i] = 0;
+    return true;
+}
+
+// Physical replies, 0x7E8-0x7EF and 0x18DAF1xx
+static bool isObdReplyId(uint32_t id, bool extended) {
+    if (extended) return (id & 0x1FFFFF00) == 0x18DAF100;
+    return id >= 0x7E8 && id <= 0x7EF;
+}
+
+static void addSample(DecodeChunk &chunk, unsigned column, double time, float value) {
+    chunk.columns[column].time.push_back(time);
+    chunk.columns[column].value.push_back(value);
+    chunk.samples++;
+}
+
+static void decodeCandumpLine(DecodeChunk &chunk, const char *p, const char *end) {
+
+    double time;
+    uint32_t id;
+    bool extended;
+    uint8_t data[8];
+    uint8_t len;
+    if (!parseCandump(p, end, time, id, extended, data, len)) {
+        chunk.failures++;
+        return;
+    }
+    chunk.frames++;
+
+    if (isObdReplyId(id, extended)) {
+        uint8_t pid;
+        float value;
+        if (len == 8 && decodeObdFrame(data, pid, value)) addSample(chunk, pid, time, value);
+        return;
+    }
+
+    int index = signalFirst(id, extended);
+    if (index < 0) return;
+
+    uint64_t little, big;
+    signalFrameWords(data, len, little, big);
+    for (; index >= 0; index = signals[index].next) {
+        if (len < signals[index].min_len) continue;
+        addSample(chunk, PID_SIZE + index, time, signalValue(signals[index], little, big));
+    }
+}
+
+static int findSignal(const char *name) {
+    for (unsigned i=0; i<signal_count; i++) {
+        if (!strcmp(signals[i].name, name)) return i;
+    }
+    return -1;
+}
+
+static void decodeSerial4Line(DecodeChunk &chunk, DynamicJsonDocument *&json, const char *p, const char *end) {
+
+    double time = NAN;
+    const char *json_start = parseSeconds(p, end, time);
+    if (json_start) {
+        while (json_start < end && *json_start == ' ') json_start++;
+    } else {
+        json_start = p;
+    }
+    if (json_start == end || *json_start != '{') {
+        chunk.failures++;
+        return;
+    }
+
+    // Sized from the line like signal_db.cpp, and grown if that wasn't enough:
+    // slots are twice as large on a 64-bit host as on the device
+    size_t size = end - json_start;
+    if (!json || json->capacity() < size * 2 + 1024) {
+        delete json;
+        json = new DynamicJsonDocument(size * 2 + 1024);
+    }
+    DeserializationError error = deserializeJson(*json, json_start, size);
+    while (error == DeserializationError::NoMemory && json->capacity() < DECODE_JSON_MAX_SIZE) {
+        size_t capacity = json->capacity() * 2;
+        delete json;
+        json = new DynamicJsonDocument(capacity);
+        error = deserializeJson(*json, json_start, size);
+    }
+    if (error != DeserializationError::Ok) {
+        chunk.failures++;
+        return;
+    }
+    chunk.frames++;
+
+    JsonObject report = json->as<JsonObject>();
+
+    // Device uptime when the capture has no timestamps of its own
+    if (isnan(time) && !report["t"].isNull()) time = (report["t"] | 0UL) / 1000.0;
+
+    for (unsigned i=0; i<report["m"].size(); i++) {
+        JsonObject metric = report["m"][i].as<JsonObject>();
+        const char *value = metric["v"] | "";
+        if (!value[0]) continue;
+
+        int column = -1;
+        if (!metric["pid"].isNull()) {
+            unsigned pid = metric["pid"] | 0xFFu;
+            if (pid < PID_SIZE) column = pid;
+        } else if (!metric["sig"].isNull()) {
+            int index = findSignal(metric["sig"] | "");
+            if (index >= 0) column = PID_SIZE + index;
+        }
+        if (column >= 0) addSample(chunk, column, time, strtof(value, NULL));
+    }
+}
+
+void LogDecoder::decodeChunk(DecodeChunk &chunk) {
+
+    DynamicJsonDocument *json = NULL;
+
+    const char *p = chunk.begin;
+    while (p < chunk.end) {
+        const char *line_end = (const char *)memchr(p, '\n', chunk.end - p);
+        if (!line_end) line_end = chunk.end;
+
+        const char *content_end = line_end;
+        if (content_end > p && content_end[-1] == '\r') content_end--;
+
+        chunk.lines++;
+        if (content_end == p) {
+            // Blank
+        } else if (format_ == LOG_CANDUMP) {
+            decodeCandumpLine(chunk, p, content_end);
+        } else {
+            decodeSerial4Line(chunk, json, p, content_end);
+        }
+
+        p = line_end + 1;
+    }
+    delete json;
+}
+
+LogDecoder::LogDecoder(const char *data, size_t size, unsigned threads)
+    : data_(data), size_(size), format_(LOG_CANDUMP), directory_(NULL), binary_(false), next_column_(0), write_failed_(0) {
+
+    // The first line that isn't blank tells the format
+    const char *p = data;
+    while (p < data + size && (*p == '\n' || *p == '\r' || *p == ' ')) p++;
+    if (p < data + size && *p != '(') format_ = LOG_SERIAL4;
+
+    if (threads == 0) threads = 1;
+
+    // Chunk boundaries move forward to the next line start
+    const char *begin = data;
+    for (unsigned i=0; i<threads && begin < data + size; i++) {
+        const char *end = i + 1 == threads ? data + size : data + size * (i + 1) / threads;
+        if (end < begin) end = begin;
+        const char *newline = (const char *)memchr(end, '\n', data + size - end);
+        end = newline ? newline + 1 : data + size;
+
+        DecodeChunk *chunk = new DecodeChunk();
+        chunk->begin = begin;
+        chunk->end = end;
+        chunk->lines = 0;
+        chunk->frames = 0;
+        chunk->samples = 0;
+        chunk->failures = 0;
+        chunks_.push_back(chunk);
+        begin = end;
+    }
+}
+
+LogDecoder::~LogDecoder() {
+    for (unsigned i=0; i<chunks_.size(); i++) delete chunks_[i];
+}
+
+struct DecodeTask {
+    LogDecoder *decoder;
+    DecodeChunk *chunk;
+};
+
+void *LogDecoder::decodeMain(void *arg) {
+    DecodeTask *task = static_cast<DecodeTask *>(arg);
+    task->decoder->decodeChunk(*task->chunk);
+    return NULL;
+}
+
+bool LogDecoder::run() {
+
+    std::vector<pthread_t> threads(chunks_.size());
+    std::vector<DecodeTask> tasks(chunks_.size());
+
+    for (unsigned i=0; i<chunks_.size(); i++) {
+        tasks[i].decoder = this;
+        tasks[i].chunk = chunks_[i];
+        if (pthread_create(&threads[i], NULL, decodeMain, &tasks[i]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            for (unsigned j=0; j<i; j++) pthread_join(threads[j], NULL);
+            return false;
+        }
+    }
+    for (unsigned i=0; i<chunks_.size(); i++) pthread_join(threads[i], NULL);
+    return true;
+}
+
+unsigned long LogDecoder::lines() const {
+    unsigned long total = 0;
+    for (unsigned i=0; i<chunks_.size(); i++) total += chunks_[i]->lines;
+    return total;
+}
+
+unsigned long LogDecoder::frames() const {
+    unsigned long total = 0;
+    for (unsigned i=0; i<chunks_.size(); i++) total += chunks_[i]->frames;
+    return total;
+}
+
+unsigned long LogDecoder::samples() const {
+    unsigned long total = 0;
+    for (unsigned i=0; i<chunks_.size(); i++) total += chunks_[i]->samples;
+    return total;
+}
+
+unsigned long LogDecoder::failures() const {
+    unsigned long total = 0;
+    for (unsigned i=0; i<chunks_.size(); i++) total += chunks_[i]->failures;
+    return total;
+}
+
+size_t LogDecoder::columnSize(unsigned column) const {
+    size_t total = 0;
+    for (unsigned i=0; i<chunks_.size(); i++) total += chunks_[i]->columns[column].time.size();
+    return total;
+}
+
+String columnName(unsigned column) {
+    if (column < PID_SIZE) return getPidName(column);
+    return signals[column - PID_SIZE].name;
+}
+
+String columnUnits(unsigned column) {
+    if (column < PID_SIZE) return getPidUnits(column);
+    return signals[column - PID_SIZE].unit;
+}
+
+// pid_0c / sig_rpm. Signal names come from the database, anything outside
+// [A-Za-z0-9_] becomes '_' so a name can't leave the output directory
+static String columnFileName(unsigned column) {
+    char name[32];
+    if (column < PID_SIZE) {
+        snprintf(name, sizeof(name), "pid_%02x", column);
+        return name;
+    }
+
+    snprintf(name, sizeof(name), "sig_%s", signals[column - PID_SIZE].name);
+    for (char *p = name + 4; *p; p++) {
+        if (!isalnum((unsigned char)*p) && *p != '_') *p = '_';
+    }
+    return name;
+}
+
+bool LogDecoder::writeColumn(unsigned column) {
+
+    size_t count = columnSize(column);
+    if (!count) return true;
+
+    String path = String(directory_) + "/" + file_names_[column] + (binary_ ? ".bin" : ".csv");
+    FILE *file = fopen(path.c_str(), binary_ ? "wb" : "w");
+    if (!file) {
+        perror(path.c_str());
+        return false;
+    }
+
+    if (binary_) {
+        DecodeFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, DECODE_FILE_MAGIC, 4);
+        header.version = DECODE_FILE_VERSION;
+        header.column = column;
+        header.count = count;
+        strncpy(header.name, columnName(column).c_str(), sizeof(header.name) - 1);
+        strncpy(header.unit, columnUnits(column).c_str(), sizeof(header.unit) - 1);
+        fwrite(&header, sizeof(header), 1, file);
+
+        for (unsigned i=0; i<chunks_.size(); i++) {
+            const DecodeColumn &part = chunks_[i]->columns[column];
+            fwrite(part.time.data(), sizeof(double), part.time.size(), file);
+        }
+        for (unsigned i=0; i<chunks_.size(); i++) {
+            const DecodeColumn &part = chunks_[i]->columns[column];
+            fwrite(part.value.data(), sizeof(float), part.value.size(), file);
+        }
+    } else {
+        fprintf(file, "time,%s (%s)\n", columnName(column).c_str(), columnUnits(column).c_str());
+        for (unsigned i=0; i<chunks_.size(); i++) {
+            const DecodeColumn &part = chunks_[i]->columns[column];
+            for (size_t j=0; j<part.time.size(); j++) fprintf(file, "%.6f,%.7g\n", part.time[j], part.value[j]);
+        }
+    }
+
+    bool ok = !ferror(file);
+    if (fclose(file) != 0) ok = false;
+    if (!ok) fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+    return ok;
+}
+
+void *LogDecoder::writeMain(void *arg) {
+    LogDecoder *decoder = static_cast<LogDecoder *>(arg);
+
+    unsigned column;
+    while ((column = __sync_fetch_and_add(&decoder->next_column_, 1)) < DECODE_COLUMNS) {
+        if (!decoder->writeColumn(column)) __sync_fetch_and_or(&decoder->write_failed_, 1);
+    }
+    return NULL;
+}
+
+bool LogDecoder::write(const char *directory, bool binary) {
+
+    directory_ = directory;
+    binary_ = binary;
+    next_column_ = 0;
+    write_failed_ = 0;
+
+    // Signal names that sanitize to the same file name ("a-b", "a.b") or are
+    // duplicated get their signal index appended, sig_a_b / sig_a_b_1
+    file_names_.assign(DECODE_COLUMNS, String());
+    for (unsigned column=0; column<DECODE_COLUMNS; column++) {
+        if (!columnSize(column)) continue;
+
+        String name = columnFileName(column);
+        for (bool taken = true; taken; ) {
+            taken = false;
+            for (unsigned i=0; i<column && !taken; i++) taken = file_names_[i] == name;
+            if (taken) name += "_" + String(column - PID_SIZE);
+        }
+        file_names_[column] = name;
+    }
+
+    std::vector<pthread_t> threads(chunks_.size());
+    unsigned started = 0;
+    for (; started<threads.size(); started++) {
+        if (pthread_create(&threads[started], NULL, writeMain, this) != 0) break;
+    }
+    if (!started) writeMain(this);
+    for (unsigned i=0; i<started; i++) pthread_join(threads[i], NULL);
+
+    return !write_failed_;
+}
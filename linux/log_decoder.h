@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "obd2.h"
+#include "signals.h"
+
+// Offline decoder for captures taken on a drive, through the same decode path
+// as the device (decodeObdFrame(), getPidValue(), the signals.h table):
+//
+//   candump -L         (1697040000.123456) can0 7E8#06410C1AF8AAAAAA
+//   Serial4 reports    [<seconds> ]{"cr":true,"t":81234,...,"m":[{"pid":12,"v":"1739","u":"rpm"},...]}
+//
+// The capture is memory-mapped and split into one chunk per thread at line
+// boundaries; each thread decodes its chunk into its own columns, so no
+// locking is needed and columns are read back in capture order chunk by chunk.
+// Serial4 lines without a timestamp prefix are stamped with the device's uptime
+// from "t" (seconds since boot), or NaN if the report has none; "sig" entries
+// are matched by name against the loaded signal database.
+
+// Columns: OBD PIDs 0..PID_SIZE-1, then the loaded signals
+#define DECODE_COLUMNS (PID_SIZE + SIGNAL_MAX)
+
+// Binary column file: this header, then double time[count], then float value[count]
+#define DECODE_FILE_MAGIC "CLDC"
+#define DECODE_FILE_VERSION 1
+
+// Largest JSON document for one Serial4 line
+#define DECODE_JSON_MAX_SIZE (1 << 20)
+
+struct DecodeFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t column;
+    uint32_t count;
+    char name[64];
+    char unit[16];
+};
+
+enum LogFormat {
+    LOG_CANDUMP,
+    LOG_SERIAL4,
+};
+
+struct DecodeColumn {
+    std::vector<double> time;
+    std::vector<float> value;
+};
+
+struct DecodeChunk {
+    const char *begin;
+    const char *end;
+    unsigned long lines;
+    unsigned long frames;
+    unsigned long samples;
+    unsigned long failures;     // lines that are neither a frame nor a report
+    DecodeColumn columns[DECODE_COLUMNS];
+};
+
+class LogDecoder {
+public:
+    LogDecoder(const char *data, size_t size, unsigned threads);
+    ~LogDecoder();
+
+    LogFormat format() const { return format_; }
+
+    // Decodes every chunk on its own thread
+    bool run();
+
+    // One file per column with samples, pid_0c.csv / sig_rpm.bin, written in parallel.
+    // Signal file names are made unique, see write()
+    bool write(const char *directory, bool binary);
+
+    unsigned long lines() const;
+    unsigned long frames() const;
+    unsigned long samples() const;
+    unsigned long failures() const;
+    size_t columnSize(unsigned column) const;
+
+private:
+    static void *decodeMain(void *arg);
+    static void *writeMain(void *arg);
+    void decodeChunk(DecodeChunk &chunk);
+    bool writeColumn(unsigned column);
+
+    const char *data_;
+    size_t size_;
+    LogFormat format_;
+    std::vector<DecodeChunk *> chunks_;
+
+    // Shared by the writer threads, columns are claimed with __sync_fetch_and_add
+    std::vector<String> file_names_;
+    const char *directory_;
+    bool binary_;
+    unsigned next_column_;
+    int write_failed_;
+};
+
+String columnName(unsigned column);
+String columnUnits(unsigned column);
@@ -0,0 +1,162 @@
+// carloop-gateway: the Electron OBD poller as a Linux daemon on SocketCAN
+//
+//   carloop-gateway -i can0                      # JSON lines on stdout
+//   carloop-gateway -i vcan0 -o /run/carloop.sock -p 12,13
+//   carloop-gateway -l                           # in-process loopback with a simulated ECU
+//   carloop-gateway -l -d sim-signals.json       # plus the simulated broadcast frames
+
+#include "gateway.h"
+#include "ecu_sim.h"
+#include "obd_poller.h"
+#include "subscription.h"
+#include "periodic.h"
+#include "signal_db.h"
+
+#include <getopt.h>
+#include <signal.h>
+
+static volatile sig_atomic_t stop_requested = 0;
+static bool verbose = false;
+
+void debug_print(String msg) {
+    if (verbose) fprintf(stderr, "%s\n", msg.c_str());
+}
+
+static void onSignal(int) {
+    stop_requested = 1;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "usage: %s (-i <ifname> | -l) [-o <unix socket>] [-p pid,pid,...]\n"
+        "          [-r request_ms] [-R report_ms] [-a] [-s subscription]... [-P periodic] [-d signals.json] [-x] [-v]\n"
+        "  -i  SocketCAN interface (can0, vcan0)\n"
+        "  -l  in-process loopback against the simulated ECU\n"
+        "  -o  serve report lines on a Unix stream socket instead of stdout\n"
+        "  -p  only poll and report these PIDs (default: all supported)\n"
+        "  -r  request period in ms (default 100, 0 = back-to-back)\n"
+        "  -R  report period in ms (default 1000)\n"
+        "  -s  extra named report, e.g. '{\"id\":\"dash\",\"pids\":[12,13],\"ms\":200}'\n"
+        "  -P  have the ECU push these PIDs, e.g. '{\"pids\":[12,13],\"rate\":\"fast\"}'\n"
+        "  -d  decode broadcast frames with this signal database (the \"sig\" object of signals.h)\n"
+        "  -a  add min/max/mean/stddev since the last report to every metric\n"
+        "  -x  29-bit addressing (0x18DA10F1 / 0x18DAF110)\n"
+        "  -v  debug output on stderr\n", argv0);
+}
+
+// Engine ECU behind 29-bit ISO 15765-4 addressing
+static void useExtendedAddressing() {
+    obd_request_id = 0x18DA10F1;
+    obd_reply_id = 0x18DAF110;
+    obd_extended = true;
+}
+
+// Same effect as a { "all": 0, "pids": [...] } control message on Serial4
+static bool parsePidList(char *list) {
+    uint8_t pids[PID_SIZE];
+    unsigned count = 0;
+    for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+        long pid = strtol(tok, NULL, 0);
+        if (pid < 0 || pid >= PID_SIZE || count == PID_SIZE) return false;
+        pids[count++] = pid;
+    }
+    return setDefaultSubscription(count == 0, pids, count);
+}
+
+// Same effect as a { "sub": {...} } control message on Serial4
+static bool addSubscription(const char *config) {
+    DynamicJsonDocument json(1024);
+    if (deserializeJson(json, config) != DeserializationError::Ok) return false;
+    return subscriptionConfigure(json.as<JsonObject>());
+}
+
+// Same effect as a { "periodic": {...} } control message on Serial4
+static bool requestPeriodic(const char *config) {
+    DynamicJsonDocument json(1024);
+    if (deserializeJson(json, config) != DeserializationError::Ok) return false;
+    return periodicConfigure(json.as<JsonObject>());
+}
+
+int main(int argc, char **argv) {
+    const char *ifname = NULL;
+    const char *socket_path = NULL;
+    char *pid_list = NULL;
+    const char *subscription_args[SUBSCRIPTION_MAX];
+    unsigned subscription_arg_count = 0;
+    const char *periodic_arg = NULL;
+    const char *signals_path = NULL;
+    bool loopback = false;
+    GatewayConfig config;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:lo:p:r:R:s:P:d:axvh")) != -1) {
+        switch (opt) {
+            case 'i': ifname = optarg; break;
+            case 'l': loopback = true; break;
+            case 'o': socket_path = optarg; break;
+            case 'p': pid_list = optarg; break;
+            case 'r': config.request_interval_ms = atoi(optarg); break;
+            case 'R': config.report_interval_ms = atoi(optarg); break;
+            case 's': if (subscription_arg_count < SUBSCRIPTION_MAX) subscription_args[subscription_arg_count++] = optarg; break;
+            case 'P': periodic_arg = optarg; break;
+            case 'd': signals_path = optarg; break;
+            case 'a': aggregate_mode = true; break;
+            case 'x': useExtendedAddressing(); break;
+            case 'v': verbose = true; break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (!ifname == !loopback) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    resetOBDSupportData();
+    if (pid_list && !parsePidList(pid_list)) {
+        fprintf(stderr, "invalid PID list\n");
+        return 2;
+    }
+    for (unsigned i=0; i<subscription_arg_count; i++) {
+        if (!addSubscription(subscription_args[i])) {
+            fprintf(stderr, "invalid subscription: %s\n", subscription_args[i]);
+            return 2;
+        }
+    }
+
+    if (periodic_arg && !requestPeriodic(periodic_arg)) {
+        fprintf(stderr, "invalid periodic request: %s\n", periodic_arg);
+        return 2;
+    }
+
+    // Same effect as a { "sig": {...} } control message on Serial4
+    if (signals_path && !loadSignalDatabase(signals_path)) {
+        fprintf(stderr, "invalid signal database: %s\n", signals_path);
+        return 2;
+    }
+
+    SocketCan can;
+    SocketCan ecu_can;
+    EcuSim ecu(ecu_can);
+
+    if (loopback) {
+        int fds[2];
+        if (!socketCanLoopbackPair(fds)) return 1;
+        can.openLoopback(fds[0]);
+        ecu_can.openLoopback(fds[1]);
+        if (!ecu.start()) return 1;
+    } else if (!can.open(ifname)) {
+        return 1;
+    }
+
+    OutputSink output;
+    if (socket_path ? !output.openUnix(socket_path) : !output.openStdout()) return 1;
+
+    Gateway gateway(can, &output, config);
+    bool ok = gateway.run(&stop_requested);
+
+    ecu.stop();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+#include "output.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+OutputSink::OutputSink() : out_fd_(-1), listen_fd_(-1), client_count_(0) {
+    path_[0] = 0;
+}
+
+OutputSink::~OutputSink() {
+    close();
+}
+
+bool OutputSink::openStdout() {
+    close();
+    out_fd_ = STDOUT_FILENO;
+    return true;
+}
+
+bool OutputSink::openUnix(const char *path) {
+    close();
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (listen_fd_ < 0) {
+        perror("socket(AF_UNIX)");
+        return false;
+    }
+
+    unlink(path);
+    if (bind(listen_fd_, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd_, 4) < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        close();
+        return false;
+    }
+
+    strcpy(path_, path);
+    return true;
+}
+
+void OutputSink::close() {
+    for (unsigned i=0; i<client_count_; i++) ::close(clients_[i]);
+    client_count_ = 0;
+
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+        if (path_[0]) unlink(path_);
+    }
+    listen_fd_ = -1;
+    out_fd_ = -1;
+    path_[0] = 0;
+}
+
+void OutputSink::acceptClients() {
+    while (true) {
+        int fd = accept4(listen_fd_, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0) return;
+
+        if (client_count_ == OUTPUT_MAX_CLIENTS) {
+            ::close(fd);
+            continue;
+        }
+        clients_[client_count_++] = fd;
+    }
+}
+
+static bool writeAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == ENOTSOCK) n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+void OutputSink::writeLine(const String &line) {
+    String framed = line + "\n";
+
+    if (out_fd_ >= 0) {
+        writeAll(out_fd_, framed.c_str(), framed.length());
+        return;
+    }
+
+    for (unsigned i=0; i<client_count_; ) {
+        if (writeAll(clients_[i], framed.c_str(), framed.length())) {
+            i++;
+            continue;
+        }
+        // Client went away or can't keep up
+        ::close(clients_[i]);
+        clients_[i] = clients_[--client_count_];
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Particle.h"
+
+#define OUTPUT_MAX_CLIENTS 16
+
+// Where report lines go: stdout, or every client connected to a Unix stream socket.
+// Slow socket clients are dropped instead of stalling the poller.
+class OutputSink {
+public:
+    OutputSink();
+    ~OutputSink();
+
+    bool openStdout();
+    bool openUnix(const char *path);
+    void close();
+
+    // Listening socket to register with epoll, or -1 for stdout
+    int listenFd() const { return listen_fd_; }
+    void acceptClients();
+
+    void writeLine(const String &line);
+
+private:
+    int out_fd_;
+    int listen_fd_;
+    int clients_[OUTPUT_MAX_CLIENTS];
+    unsigned client_count_;
+    char path_[108];
+};
@@ -0,0 +1,142 @@
+// Regression cases around periodic.cpp: everything else the ECU sends on
+// obd_reply_id must stay out of the Mode 01 path, pushed PIDs must not stall
+// the poll schedule and no poll may split a two-frame definition.
+//
+//   make check
+
+#include "obd_poller.h"
+#include "periodic.h"
+#include "helper.h"
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+void debug_print(String msg) {
+    (void)msg;
+}
+
+static void setUp() {
+    resetOBDSupportData();
+    pid_enabled[ENGINE_RPM] = true;
+    pid_enabled[VEHICLE_SPEED] = true;
+}
+
+// 10 03 answered after getObdResponse() gave up and moved on to PID 3
+static void testLateSessionResponse() {
+    setUp();
+    uint8_t frame[8] = {0x06, 0x50, 0x03, 0x00, 0x32, 0x01, 0xF4, 0x00};
+    CHECK(!handleObdReply(3, frame));
+    CHECK(alldata[3] == EMPTY_VALUE);
+}
+
+// Flow control for a 2C first frame while the support PID 0x00 is pending
+static void testStrayFlowControl() {
+    setUp();
+    uint8_t frame[8] = {0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    CHECK(!handleObdReply(PIDS_SUPPORT_01_20, frame));
+    CHECK(alldata[PIDS_SUPPORT_01_20] == EMPTY_VALUE);
+    CHECK(pid_enabled[ENGINE_RPM]);
+    CHECK(pid_enabled[VEHICLE_SPEED]);
+}
+
+// 6C / 6A positive responses and a negative response to tester present
+static void testOtherUdsResponses() {
+    setUp();
+    uint8_t define[8] = {0x04, 0x6C, 0x01, 0xF2, 0x8C, 0x00, 0x00, 0x00};
+    uint8_t periodic[8] = {0x02, 0x6A, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00};
+    uint8_t negative[8] = {0x03, 0x7F, 0x3E, 0x12, 0x00, 0x00, 0x00, 0x00};
+    CHECK(!handleObdReply(1, define));
+    CHECK(!handleObdReply(3, periodic));
+    CHECK(!handleObdReply(0x3E, negative));
+    CHECK(alldata[1] == EMPTY_VALUE);
+    CHECK(alldata[3] == EMPTY_VALUE);
+    CHECK(alldata[0x3E] == EMPTY_VALUE);
+}
+
+// A late Mode 01 reply for another enabled PID is still stored, one for a
+// PID that isn't enabled is not
+static void testOtherPid() {
+    setUp();
+    uint8_t frame[8] = {0x04, 0x41, VEHICLE_SPEED, 0x32, 0x00, 0x00, 0x00, 0x00};
+    CHECK(!handleObdReply(ENGINE_RPM, frame));
+    CHECK(alldata[VEHICLE_SPEED] == 0x32);
+    CHECK(handleObdReply(VEHICLE_SPEED, frame));
+
+    uint8_t disabled[8] = {0x03, 0x41, THROTTLE_POSITION, 0x80, 0x00, 0x00, 0x00, 0x00};
+    CHECK(!handleObdReply(ENGINE_RPM, disabled));
+    CHECK(alldata[THROTTLE_POSITION] == EMPTY_VALUE);
+}
+
+// Sending all PIDs while every supported one is pushed: the schedule falls
+// back to the support PIDs instead of looking for something to poll forever
+static void testAllPidsPeriodic() {
+    setUp();
+    for (unsigned i=0; i<PID_SUPPORT_PIDS_SIZE; i++) pid_enabled[PID_SUPPORT_PIDS[i]] = false;
+    pid_periodic[ENGINE_RPM] = true;
+    pid_periodic[VEHICLE_SPEED] = true;
+    send_all_pids = true;
+
+    for (unsigned i=0; i<4; i++) {
+        int pid = nextObdRequestPid();
+        CHECK(pid != ENGINE_RPM && pid != VEHICLE_SPEED);
+    }
+    CHECK(nextObdRequestPid() == PID_SUPPORT_PIDS[0]);
+
+    pid_periodic[ENGINE_RPM] = false;
+    pid_periodic[VEHICLE_SPEED] = false;
+}
+
+// Mode 01 polling is held off from the 2C first frame until its consecutive frame
+static void testBusyDuringDefine() {
+    setUp();
+    DynamicJsonDocument config(256);
+    deserializeJson(config, "{\"pids\":[12],\"rate\":\"fast\"}");
+    CHECK(periodicConfigure(config.as<JsonObject>()));
+
+    uint8_t frame[8];
+    CHECK(periodicNextFrame(frame) && frame[1] == 0x10);
+    CHECK(!periodicBusy());
+    uint8_t session[8] = {0x06, 0x50, 0x03, 0x00, 0x32, 0x01, 0xF4, 0x00};
+    CHECK(periodicHandleFrame(session));
+
+    CHECK(!periodicBusy());
+    CHECK(periodicNextFrame(frame) && frame[0] == 0x10 && frame[2] == 0x2C);
+    CHECK(periodicBusy());
+    uint8_t flow_control[8] = {0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    CHECK(periodicHandleFrame(flow_control));
+    CHECK(periodicBusy());
+    CHECK(periodicNextFrame(frame) && frame[0] == 0x21);
+    CHECK(!periodicBusy());
+    uint8_t defined[8] = {0x04, 0x6C, 0x01, 0xF2, 0x8C, 0x00, 0x00, 0x00};
+    CHECK(periodicHandleFrame(defined));
+    CHECK(!periodicBusy());
+
+    DynamicJsonDocument stop(64);
+    deserializeJson(stop, "{\"pids\":[]}");
+    periodicConfigure(stop.as<JsonObject>());
+    while (periodicNextFrame(frame)) {}
+}
+
+int main() {
+    testLateSessionResponse();
+    testStrayFlowControl();
+    testOtherUdsResponses();
+    testOtherPid();
+    testAllPidsPeriodic();
+    testBusyDuringDefine();
+
+    if (failures) {
+        fprintf(stderr, "%d failed\n", failures);
+        return 1;
+    }
+    printf("periodic_test: ok\n");
+    return 0;
+}
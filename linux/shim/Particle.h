@@ -0,0 +1,99 @@
+#pragma once
+
+// Host stand-in for the Device OS header: just enough of Wiring (String, millis)
+// for the shared sources in ../src to build natively on Linux.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+
+#define HEX 16
+#define DEC 10
+
+typedef uint8_t byte;
+
+inline unsigned long millis() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+inline unsigned long micros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000UL;
+}
+
+class String {
+public:
+    String(const char *cstr = "") : s_(cstr ? cstr : "") {}
+    String(const std::string &str) : s_(str) {}
+    String(char c) : s_(1, c) {}
+    String(int value, int base = DEC) { fromLong(value, base); }
+    String(unsigned value, int base = DEC) { fromULong(value, base); }
+    String(long value, int base = DEC) { fromLong(value, base); }
+    String(unsigned long value, int base = DEC) { fromULong(value, base); }
+    String(unsigned char value, int base = DEC) { fromULong(value, base); }
+    String(float value, int decimals = 2) { fromDouble(value, decimals); }
+    String(double value, int decimals = 2) { fromDouble(value, decimals); }
+
+    const char *c_str() const { return s_.c_str(); }
+    unsigned length() const { return s_.length(); }
+    bool reserve(unsigned size) { s_.reserve(size); return true; }
+    char charAt(unsigned index) const { return index < s_.length() ? s_[index] : 0; }
+    char operator[](unsigned index) const { return charAt(index); }
+    int indexOf(char c, unsigned from = 0) const {
+        size_t i = s_.find(c, from);
+        return i == std::string::npos ? -1 : (int)i;
+    }
+    String substring(unsigned from, unsigned to) const { return String(s_.substr(from, to - from)); }
+    String substring(unsigned from) const { return String(s_.substr(from)); }
+    void trim() {
+        size_t b = s_.find_first_not_of(" \t\r\n");
+        size_t e = s_.find_last_not_of(" \t\r\n");
+        s_ = b == std::string::npos ? "" : s_.substr(b, e - b + 1);
+    }
+    long toInt() const { return strtol(s_.c_str(), NULL, 10); }
+    float toFloat() const { return strtof(s_.c_str(), NULL); }
+
+    bool concat(const String &str) { s_ += str.s_; return true; }
+    bool concat(const char *cstr) { if (cstr) s_ += cstr; return true; }
+    bool concat(char c) { s_ += c; return true; }
+
+    String &operator=(const char *cstr) { s_ = cstr ? cstr : ""; return *this; }
+    String &operator+=(const String &str) { concat(str); return *this; }
+    String &operator+=(const char *cstr) { concat(cstr); return *this; }
+    String &operator+=(char c) { concat(c); return *this; }
+
+    bool operator==(const String &rhs) const { return s_ == rhs.s_; }
+    bool operator==(const char *rhs) const { return s_ == (rhs ? rhs : ""); }
+    bool operator!=(const String &rhs) const { return s_ != rhs.s_; }
+    bool operator!=(const char *rhs) const { return !(*this == rhs); }
+
+    friend String operator+(const String &lhs, const String &rhs) { return String(lhs.s_ + rhs.s_); }
+
+private:
+    void fromLong(long value, int base) {
+        if (value < 0 && base == DEC) { s_ = "-"; appendULong((unsigned long)-value, base); }
+        else appendULong((unsigned long)value, base);
+    }
+    void fromULong(unsigned long value, int base) { appendULong(value, base); }
+    void appendULong(unsigned long value, int base) {
+        char buf[sizeof(unsigned long) * 8 + 1];
+        char *p = &buf[sizeof(buf) - 1];
+        *p = 0;
+        do { unsigned d = value % base; *--p = d < 10 ? '0' + d : 'a' + d - 10; value /= base; } while (value);
+        s_ += p;
+    }
+    void fromDouble(double value, int decimals) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+        s_ = buf;
+    }
+
+    std::string s_;
+};
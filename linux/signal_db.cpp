@@ -0,0 +1,23 @@
+#include "signal_db.h"
+#include "signals.h"
+
+#include <stdio.h>
+#include <string>
+
+bool loadSignalDatabase(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+
+    std::string text;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) text.append(buffer, n);
+    fclose(file);
+
+    DynamicJsonDocument json(text.size() * 2 + 1024);
+    if (deserializeJson(json, text) != DeserializationError::Ok) return false;
+    return signalsConfigure(json.as<JsonObject>());
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// Loads a signal database file: the "sig" object of a { "sig": {...} }
+// control message (see signals.h), e.g. sim-signals.json
+bool loadSignalDatabase(const char *path);
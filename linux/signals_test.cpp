@@ -0,0 +1,126 @@
+// Table-driven decoding cases for signals.cpp: Intel and Motorola byte orders,
+// signed values, signals crossing byte boundaries, scale / offset and the
+// definitions addSignal() has to refuse. Expected values are worked out by hand
+// from the DBC bit numbering.
+//
+//   make check
+
+#include "signals.h"
+#include "helper.h"
+
+#include <math.h>
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+void debug_print(String msg) {
+    (void)msg;
+}
+
+struct SignalCase {
+    const char *name;
+    const char *definition;     // one entry of "add", always on frame 0x100
+    uint8_t data[8];
+    uint8_t len;
+    float expected;
+};
+
+static const SignalCase cases[] = {
+    { "intel byte",         "{\"can\":256,\"sb\":8,\"len\":8}",
+        {0x00, 0x7B}, 8, 123 },
+    { "intel 16 scaled",    "{\"can\":256,\"sb\":0,\"len\":16,\"sc\":0.25}",
+        {0x40, 0x1F}, 8, 2000 },
+    { "intel nibble cross", "{\"can\":256,\"sb\":4,\"len\":12}",
+        {0xA0, 0x5B}, 8, 0x5BA },
+    { "intel odd cross",    "{\"can\":256,\"sb\":13,\"len\":8}",
+        {0x00, 0xA0, 0x15}, 8, 0xAD },
+    { "intel 32",           "{\"can\":256,\"sb\":32,\"len\":32}",
+        {0, 0, 0, 0, 0x78, 0x56, 0x34, 0x12}, 8, (float)0x12345678 },
+    { "intel signed",       "{\"can\":256,\"sb\":0,\"len\":16,\"sg\":1,\"sc\":0.1}",
+        {0x38, 0xFF}, 8, -20 },
+    { "intel signed pos",   "{\"can\":256,\"sb\":0,\"len\":8,\"sg\":1}",
+        {0x7F}, 8, 127 },
+    { "intel offset",       "{\"can\":256,\"sb\":0,\"len\":8,\"of\":-40}",
+        {0x50}, 8, 40 },
+    { "motorola 16 scaled", "{\"can\":256,\"sb\":7,\"len\":16,\"be\":1,\"sc\":0.25}",
+        {0x1F, 0x40}, 8, 2000 },
+    { "motorola nibble",    "{\"can\":256,\"sb\":3,\"len\":12,\"be\":1}",
+        {0xF5, 0xBA}, 8, 0x5BA },
+    { "motorola odd cross", "{\"can\":256,\"sb\":12,\"len\":8,\"be\":1}",
+        {0x00, 0x15, 0xA0}, 8, 0xAD },
+    { "motorola signed",    "{\"can\":256,\"sb\":23,\"len\":8,\"be\":1,\"sg\":1,\"of\":40}",
+        {0x00, 0x00, 0x9C}, 8, -60 },
+    { "short frame",        "{\"can\":256,\"sb\":8,\"len\":16}",
+        {0x00, 0x11, 0x22}, 2, EMPTY_VALUE },
+};
+
+static bool configure(const char *definitions) {
+    DynamicJsonDocument json(2048);
+    String config = String("{\"clr\":1,\"add\":[") + definitions + "]}";
+    deserializeJson(json, config.c_str());
+    return signalsConfigure(json.as<JsonObject>());
+}
+
+static void testCases() {
+    for (unsigned i=0; i<sizeof(cases) / sizeof(cases[0]); i++) {
+        const SignalCase &c = cases[i];
+        if (!configure(c.definition)) {
+            fprintf(stderr, "%s: not accepted\n", c.name);
+            failures++;
+            continue;
+        }
+
+        signalsDecode(0x100, false, c.data, c.len);
+        float value = signals[0].value;
+        if (fabs(value - c.expected) > 1e-3 * fmax(1.0, fabs(c.expected))) {
+            fprintf(stderr, "%s: %f, expected %f\n", c.name, value, c.expected);
+            failures++;
+        }
+    }
+}
+
+// Two signals on one frame, and frames with other ids or the other id length
+static void testFrameLookup() {
+    CHECK(configure("{\"can\":256,\"sb\":0,\"len\":8},{\"can\":256,\"sb\":15,\"len\":8,\"be\":1}"));
+
+    uint8_t data[8] = {0x12, 0x34};
+    CHECK(!signalsDecode(0x101, false, data, 8));
+    CHECK(!signalsDecode(0x100, true, data, 8));
+    CHECK(signals[0].value == EMPTY_VALUE);
+
+    CHECK(signalsDecode(0x100, false, data, 8));
+    CHECK(signals[0].value == 0x12);
+    CHECK(signals[1].value == 0x34);
+}
+
+static void testInvalidDefinitions() {
+    CHECK(!configure("{\"can\":256,\"sb\":0,\"len\":33}"));
+    CHECK(!configure("{\"can\":256,\"sb\":0,\"len\":0}"));
+    CHECK(!configure("{\"can\":256,\"sb\":60,\"len\":8}"));
+    CHECK(!configure("{\"can\":256,\"sb\":56,\"len\":16,\"be\":1}"));
+    CHECK(!configure("{\"can\":2048,\"sb\":0,\"len\":8}"));
+    CHECK(signal_count == 0);
+
+    CHECK(configure("{\"can\":2048,\"x\":1,\"sb\":0,\"len\":8}"));
+    CHECK(configure("{\"can\":256,\"sb\":63,\"len\":8,\"be\":1}"));
+}
+
+int main() {
+    testCases();
+    testFrameLookup();
+    testInvalidDefinitions();
+
+    if (failures) {
+        fprintf(stderr, "%d failed\n", failures);
+        return 1;
+    }
+    printf("signals_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include "socketcan.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/can/error.h>
+#include <linux/can/raw.h>
+
+static bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return false;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+SocketCan::SocketCan() : fd_(-1), loopback_(false), filter_count_(0) {}
+
+SocketCan::~SocketCan() {
+    close();
+}
+
+bool SocketCan::open(const char *ifname) {
+    close();
+
+    fd_ = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (fd_ < 0) {
+        perror("socket(PF_CAN)");
+        return false;
+    }
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(fd_, SIOCGIFINDEX, &ifr) < 0) {
+        fprintf(stderr, "%s: %s\n", ifname, strerror(errno));
+        close();
+        return false;
+    }
+
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(fd_, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind(PF_CAN)");
+        close();
+        return false;
+    }
+
+    // Bus-off and controller errors tell the gateway the car isn't ready
+    can_err_mask_t err_mask = CAN_ERR_BUSOFF | CAN_ERR_CRTL;
+    setsockopt(fd_, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &err_mask, sizeof(err_mask));
+
+    loopback_ = false;
+    return setNonBlocking(fd_);
+}
+
+bool SocketCan::openLoopback(int fd) {
+    close();
+    fd_ = fd;
+    loopback_ = true;
+    return setNonBlocking(fd_);
+}
+
+void SocketCan::close() {
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+    filter_count_ = 0;
+}
+
+bool SocketCan::setReceiveFilter(const canid_t *ids, unsigned count) {
+    if (count > SOCKETCAN_MAX_FILTERS) return false;
+
+    filter_count_ = count;
+    for (unsigned i=0; i<count; i++) filters_[i] = ids[i];
+
+    if (loopback_) return true;
+
+    struct can_filter filters[SOCKETCAN_MAX_FILTERS];
+    for (unsigned i=0; i<count; i++) {
+        filters[i].can_id = ids[i];
+        filters[i].can_mask = (ids[i] & CAN_EFF_FLAG)
+            ? (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_EFF_MASK)
+            : (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_SFF_MASK);
+    }
+
+    if (setsockopt(fd_, SOL_CAN_RAW, CAN_RAW_FILTER, filters, count * sizeof(filters[0])) < 0) {
+        perror("setsockopt(CAN_RAW_FILTER)");
+        return false;
+    }
+    return true;
+}
+
+bool SocketCan::transmit(const struct can_frame &frame) {
+    ssize_t n = write(fd_, &frame, sizeof(frame));
+    return n == (ssize_t)sizeof(frame);
+}
+
+bool SocketCan::receive(struct can_frame &frame) {
+    while (true) {
+        ssize_t n = read(fd_, &frame, sizeof(frame));
+        if (n != (ssize_t)sizeof(frame)) return false;
+
+        // The kernel already filtered raw sockets; error frames always pass
+        if (!loopback_ || (frame.can_id & CAN_ERR_FLAG) || accepts(frame.can_id)) return true;
+    }
+}
+
+bool SocketCan::accepts(canid_t id) const {
+    if (filter_count_ == 0) return true;
+    for (unsigned i=0; i<filter_count_; i++) {
+        if (filters_[i] == (id & ~CAN_RTR_FLAG)) return true;
+    }
+    return false;
+}
+
+bool socketCanLoopbackPair(int fds[2]) {
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) < 0) {
+        perror("socketpair");
+        return false;
+    }
+    return true;
+}
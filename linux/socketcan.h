@@ -0,0 +1,40 @@
+#pragma once
+
+#include <linux/can.h>
+
+// The OBD reply id plus one per frame carrying decoded signals
+#define SOCKETCAN_MAX_FILTERS 40
+
+// Non-blocking CAN transport. Either a PF_CAN raw socket bound to an interface
+// (can0, vcan0) or one end of an in-process AF_UNIX SOCK_SEQPACKET loopback
+// carrying struct can_frame, so the gateway can be driven without a kernel CAN device.
+class SocketCan {
+public:
+    SocketCan();
+    ~SocketCan();
+
+    bool open(const char *ifname);
+    bool openLoopback(int fd);
+    void close();
+
+    // Only deliver these ids. On a raw socket this is CAN_RAW_FILTER, so
+    // unrelated bus traffic never reaches userspace
+    bool setReceiveFilter(const canid_t *ids, unsigned count);
+
+    bool transmit(const struct can_frame &frame);
+    bool receive(struct can_frame &frame);
+
+    int fd() const { return fd_; }
+    bool isLoopback() const { return loopback_; }
+
+private:
+    bool accepts(canid_t id) const;
+
+    int fd_;
+    bool loopback_;
+    canid_t filters_[SOCKETCAN_MAX_FILTERS];
+    unsigned filter_count_;
+};
+
+// Creates a connected pair of loopback endpoints (gateway side, ECU side)
+bool socketCanLoopbackPair(int fds[2]);
@@ -0,0 +1,39 @@
+#include "aggregate.h"
+
+PidAggregate aggregates[PID_SIZE];
+
+void aggregateSample(uint8_t pid, float value) {
+
+    if (pid >= PID_SIZE) return;
+
+    PidAggregate &aggregate = aggregates[pid];
+    if (aggregate.count == 0xFFFF) return;
+
+    if (aggregate.count == 0) {
+        aggregate.min = value;
+        aggregate.max = value;
+    }
+    if (value < aggregate.min) aggregate.min = value;
+    if (value > aggregate.max) aggregate.max = value;
+
+    aggregate.count++;
+    float delta = value - aggregate.mean;
+    aggregate.mean += delta / aggregate.count;
+    aggregate.m2 += delta * (value - aggregate.mean);
+}
+
+void aggregateResetAll() {
+    for (unsigned i=0; i<PID_SIZE; i++) {
+        aggregates[i].count = 0;
+        aggregates[i].min = 0;
+        aggregates[i].max = 0;
+        aggregates[i].mean = 0;
+        aggregates[i].m2 = 0;
+    }
+}
+
+// Sample standard deviation of the window
+float aggregateStddev(const PidAggregate &aggregate) {
+    if (aggregate.count < 2) return 0;
+    return sqrt(aggregate.m2 / (aggregate.count - 1));
+}
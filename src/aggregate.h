@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Particle.h"
+#include "obd2.h"
+
+// Running statistics per PID between two reports (Welford's method), so a
+// 1 Hz report still describes every sample polled in between. O(1) memory
+// per PID; the whole window is cleared when a report is emitted.
+struct PidAggregate {
+    uint16_t count;
+    float min;
+    float max;
+    float mean;
+    float m2;
+};
+
+extern PidAggregate aggregates[PID_SIZE];
+
+void aggregateSample(uint8_t pid, float value);
+void aggregateResetAll();
+float aggregateStddev(const PidAggregate &aggregate);
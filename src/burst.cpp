@@ -0,0 +1,310 @@
+#include "burst.h"
+#include "obd2.h"
+
+enum BurstState {
+    BURST_DISARMED,
+    BURST_ARMED,        // rolling pre-trigger window
+    BURST_POST,         // window frozen, recording post-trigger samples
+    BURST_SENDING,      // draining the burst in chunks
+};
+
+enum BurstOp {
+    OP_ABOVE,
+    OP_BELOW,
+    OP_RISE,
+    OP_FALL,
+    OP_RATE_ABOVE,
+    OP_RATE_BELOW,
+    OP_BIT_SET,
+};
+
+struct BurstTrigger {
+    uint8_t pid;
+    uint8_t op;
+    float threshold;
+    bool has_last;
+    float last_value;
+    uint32_t last_raw;      // "bit" compares the data bytes, a float can't hold 32 bits
+    unsigned long last_ms;
+};
+
+struct BurstSample {
+    unsigned long ms;
+    float value;
+    uint8_t pid;
+};
+
+static BurstState state = BURST_DISARMED;
+
+static uint8_t capture_pids[BURST_MAX_PIDS];
+static unsigned capture_count = 0;
+
+// Capture PIDs plus trigger PIDs, polled round robin while armed
+static uint8_t poll_pids[BURST_MAX_PIDS + BURST_MAX_TRIGGERS];
+static unsigned poll_count = 0;
+static unsigned poll_index = 0;
+
+static BurstTrigger triggers[BURST_MAX_TRIGGERS];
+static unsigned trigger_count = 0;
+
+static unsigned long pre_ms = 0;
+static unsigned long post_ms = 0;
+
+// Share of the buffer kept for post-trigger samples, in proportion to post / (pre + post)
+static unsigned post_reserve = 0;
+
+// Ring buffer, oldest sample at sample_head
+static BurstSample samples[BURST_MAX_SAMPLES];
+static unsigned sample_head = 0;
+static unsigned sample_count = 0;
+
+static unsigned long trigger_ms = 0;
+static int fired_trigger = -1;
+static unsigned pre_count = 0;      // samples up to the trigger still in the buffer
+static bool truncated = false;
+static bool evicted = false;        // the armed ring overflowed, last_evicted_ms was dropped
+static unsigned long last_evicted_ms = 0;
+static unsigned burst_id = 0;
+static unsigned send_index = 0;
+static unsigned long last_chunk_ms = 0;
+
+static bool parseOp(const char *op, uint8_t &code) {
+    if (!strcmp(op, ">")) code = OP_ABOVE;
+    else if (!strcmp(op, "<")) code = OP_BELOW;
+    else if (!strcmp(op, "rise")) code = OP_RISE;
+    else if (!strcmp(op, "fall")) code = OP_FALL;
+    else if (!strcmp(op, "rate>")) code = OP_RATE_ABOVE;
+    else if (!strcmp(op, "rate<")) code = OP_RATE_BELOW;
+    else if (!strcmp(op, "bit")) code = OP_BIT_SET;
+    else return false;
+    return true;
+}
+
+static void addPollPid(uint8_t pid) {
+    for (unsigned i=0; i<poll_count; i++) {
+        if (poll_pids[i] == pid) return;
+    }
+    poll_pids[poll_count++] = pid;
+}
+
+static void resetTriggerHistory() {
+    for (unsigned i=0; i<trigger_count; i++) triggers[i].has_last = false;
+}
+
+bool burstConfigure(JsonObject config) {
+
+    state = BURST_DISARMED;
+    sample_head = 0;
+    sample_count = 0;
+    evicted = false;
+    capture_count = 0;
+    trigger_count = 0;
+    poll_count = 0;
+    poll_index = 0;
+
+    unsigned count = config["trig"].size();
+    if (count == 0) return true;
+
+    for (unsigned i=0; i<config["pids"].size() && capture_count < BURST_MAX_PIDS; i++) {
+        unsigned pid = config["pids"][i] | 0xFF;
+        if (pid >= PID_SIZE) continue;
+        capture_pids[capture_count++] = pid;
+        addPollPid(pid);
+    }
+
+    for (unsigned i=0; i<count && trigger_count < BURST_MAX_TRIGGERS; i++) {
+        BurstTrigger &trigger = triggers[trigger_count];
+        unsigned pid = config["trig"][i]["pid"] | 0xFF;
+        const char *op = config["trig"][i]["op"] | "";
+        if (pid >= PID_SIZE || !parseOp(op, trigger.op)) return false;
+
+        trigger.pid = pid;
+        trigger.threshold = config["trig"][i]["v"] | 0.0f;
+        trigger.has_last = false;
+        trigger_count++;
+        addPollPid(pid);
+    }
+
+    long pre = config["pre"] | 5L;
+    long post = config["post"] | 5L;
+    if (pre < 0 || post < 0) return false;
+
+    pre_ms = pre * 1000UL;
+    post_ms = post * 1000UL;
+    post_reserve = pre_ms + post_ms ? BURST_MAX_SAMPLES * post_ms / (pre_ms + post_ms) : 0;
+    state = BURST_ARMED;
+    return true;
+}
+
+bool burstArmed() {
+    return state == BURST_ARMED || state == BURST_POST;
+}
+
+int burstNextPid() {
+    if (poll_count == 0) return -1;
+    poll_index = (poll_index + 1) % poll_count;
+    return poll_pids[poll_index];
+}
+
+static bool isCapturePid(uint8_t pid) {
+    for (unsigned i=0; i<capture_count; i++) {
+        if (capture_pids[i] == pid) return true;
+    }
+    return false;
+}
+
+static void dropSamplesBefore(unsigned long ms) {
+    while (sample_count > 0 && (long)(samples[sample_head].ms - ms) < 0) {
+        sample_head = (sample_head + 1) % BURST_MAX_SAMPLES;
+        sample_count--;
+    }
+}
+
+static void recordSample(uint8_t pid, float value, unsigned long now) {
+
+    if (state == BURST_ARMED) {
+        dropSamplesBefore(now - pre_ms);
+        if (sample_count == BURST_MAX_SAMPLES) {
+            evicted = true;
+            last_evicted_ms = samples[sample_head].ms;
+            sample_head = (sample_head + 1) % BURST_MAX_SAMPLES;
+            sample_count--;
+        }
+    }
+
+    // A full buffer after the trigger: the oldest pre-trigger samples make room
+    // until the post-trigger share is reached, later samples are dropped
+    if (sample_count == BURST_MAX_SAMPLES) {
+        truncated = true;
+        if (pre_count <= BURST_MAX_SAMPLES - post_reserve) return;
+        sample_head = (sample_head + 1) % BURST_MAX_SAMPLES;
+        sample_count--;
+        pre_count--;
+    }
+
+    BurstSample &sample = samples[(sample_head + sample_count) % BURST_MAX_SAMPLES];
+    sample.ms = now;
+    sample.value = value;
+    sample.pid = pid;
+    sample_count++;
+}
+
+static bool triggerFires(BurstTrigger &trigger, float value, uint32_t raw, unsigned long now) {
+
+    bool fire = false;
+    float last = trigger.last_value;
+    unsigned long elapsed = now - trigger.last_ms;
+
+    switch (trigger.op) {
+        case OP_ABOVE:
+            fire = value > trigger.threshold;
+            break;
+        case OP_BELOW:
+            fire = value < trigger.threshold;
+            break;
+        case OP_RISE:
+            fire = trigger.has_last && last <= trigger.threshold && value > trigger.threshold;
+            break;
+        case OP_FALL:
+            fire = trigger.has_last && last >= trigger.threshold && value < trigger.threshold;
+            break;
+        case OP_RATE_ABOVE:
+            fire = trigger.has_last && elapsed > 0 && (value - last) * 1000.0 / elapsed > trigger.threshold;
+            break;
+        case OP_RATE_BELOW:
+            fire = trigger.has_last && elapsed > 0 && (value - last) * 1000.0 / elapsed < trigger.threshold;
+            break;
+        case OP_BIT_SET: {
+            uint32_t mask = 1UL << ((unsigned)trigger.threshold & 0x1F);
+            fire = trigger.has_last && !(trigger.last_raw & mask) && (raw & mask);
+            break;
+        }
+    }
+
+    trigger.has_last = true;
+    trigger.last_value = value;
+    trigger.last_raw = raw;
+    trigger.last_ms = now;
+    return fire;
+}
+
+// Called for every decoded value, see storeMessageValue()
+void burstSample(uint8_t pid, float value, uint32_t raw) {
+
+    if (!burstArmed()) return;
+
+    unsigned long now = millis();
+    if (isCapturePid(pid)) recordSample(pid, value, now);
+
+    if (state != BURST_ARMED) return;
+
+    for (unsigned i=0; i<trigger_count; i++) {
+        if (triggers[i].pid != pid) continue;
+        if (!triggerFires(triggers[i], value, raw, now)) continue;
+
+        dropSamplesBefore(now - pre_ms);
+        trigger_ms = now;
+        fired_trigger = i;
+        pre_count = sample_count;
+        truncated = evicted && (long)(last_evicted_ms - (now - pre_ms)) >= 0;
+        state = BURST_POST;
+        return;
+    }
+}
+
+void burstLoop() {
+    if (state != BURST_POST) return;
+    if (millis() - trigger_ms < post_ms) return;
+
+    burst_id++;
+    send_index = 0;
+    last_chunk_ms = 0;
+    state = BURST_SENDING;
+}
+
+// One line of the pending burst, rate limited so the 1 Hz reports keep flowing
+// { "bu": { "id": 3, "tr": 0, "t0": 81234, "k": 0, "n": 4, "s": [ [-4980, 12, 2504], ... ] } }
+// "tc": 1 is added when the buffer was too small for the whole window
+bool burstNextChunk(String &output) {
+
+    if (state != BURST_SENDING) return false;
+    if (last_chunk_ms && millis() - last_chunk_ms < BURST_CHUNK_PERIOD_MS) return false;
+
+    DynamicJsonDocument json(4096);
+
+    unsigned chunks = (sample_count + BURST_CHUNK_SAMPLES - 1) / BURST_CHUNK_SAMPLES;
+    if (chunks == 0) chunks = 1;
+
+    json["bu"]["id"] = burst_id;
+    json["bu"]["tr"] = fired_trigger;
+    json["bu"]["t0"] = trigger_ms;
+    json["bu"]["k"] = send_index / BURST_CHUNK_SAMPLES;
+    json["bu"]["n"] = chunks;
+    if (truncated) json["bu"]["tc"] = 1;
+    json["bu"].createNestedArray("s");
+
+    unsigned count = 0;
+    while (send_index < sample_count && count < BURST_CHUNK_SAMPLES) {
+        BurstSample &sample = samples[(sample_head + send_index) % BURST_MAX_SAMPLES];
+        json["bu"]["s"][count][0] = (long)(sample.ms - trigger_ms);
+        json["bu"]["s"][count][1] = sample.pid;
+        json["bu"]["s"][count][2] = sample.value;
+        send_index++;
+        count++;
+    }
+
+    output = "";
+    serializeJson(json, output);
+    last_chunk_ms = millis();
+
+    // Done, re-arm with a fresh window
+    if (send_index >= sample_count) {
+        sample_head = 0;
+        sample_count = 0;
+        evicted = false;
+        resetTriggerHistory();
+        state = BURST_ARMED;
+    }
+
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Particle.h"
+#define ARDUINOJSON_ENABLE_PROGMEM 0
+#include <ArduinoJson.h>
+
+// Trigger-based burst capture. While armed, the capture PIDs are polled as fast
+// as the bus allows and kept in a pre-trigger ring buffer. When a trigger fires
+// the window is frozen, recording continues for the post-trigger time and the
+// samples are then sent as one burst, a few samples per line, between the
+// normal 1 Hz reports.
+//
+// { "burst": { "pids": [12, 13], "pre": 5, "post": 5,
+//              "trig": [ { "pid": 12, "op": ">", "v": 6000 }, { "pid": 13, "op": "rate>", "v": 12 } ] } }
+//
+// Trigger ops: ">" / "<" fire while the value is past v, "rise" / "fall" only
+// when it crosses v, "rate>" / "rate<" compare the change per second against v
+// and "bit" fires when bit v of the raw data bytes (A in the top byte of the
+// PID's length) goes from 0 to 1 (PID 1 bit 31 = MIL on).
+// An empty "trig" list disarms; negative "pre" or "post" are rejected.
+//
+// A window with more than BURST_MAX_SAMPLES samples is split between pre and
+// post in proportion to their times, and the burst is marked "tc": 1.
+
+#define BURST_MAX_PIDS 8
+#define BURST_MAX_TRIGGERS 4
+#define BURST_MAX_SAMPLES 600
+#define BURST_CHUNK_SAMPLES 32
+#define BURST_CHUNK_PERIOD_MS 50
+
+bool burstConfigure(JsonObject config);
+bool burstArmed();
+int burstNextPid();
+void burstSample(uint8_t pid, float value, uint32_t raw);
+void burstLoop();
+bool burstNextChunk(String &output);
@@ -0,0 +1,316 @@
+#include "can_detect.h"
+#include "obd_poller.h"
+
+#if PLATFORM_ID == 10 // Electron
+#include "stm32f2xx.h"
+#endif
+
+#define CAN_CONFIG_CACHE_MAGIC 0xCA10C0F1
+
+// Most common first
+const uint32_t CAN_BITRATES[] = {500000, 250000, 125000, 1000000};
+const unsigned CAN_BITRATES_SIZE = 4;
+
+// Probed without having heard traffic first
+const uint32_t CAN_BLIND_BITRATES[] = {500000, 250000};
+const unsigned CAN_BLIND_BITRATES_SIZE = 2;
+
+struct CanConfigCache {
+    uint32_t magic;
+    uint32_t count;
+    CanConfig configs[CAN_DETECT_CACHE_SIZE];
+};
+
+struct DetectProbe {
+    uint32_t bitrate;
+    uint32_t request_id;
+    bool extended;
+};
+
+enum DetectState {
+    DETECT_START,       // new round
+    DETECT_LISTEN,      // listen-only at bitrates[cursor]
+    DETECT_PROBE,       // probes[cursor] sent one-shot, waiting for the answer
+    DETECT_WAIT,        // round failed, next one after wait_ms
+    DETECT_DONE,
+};
+
+CanConfig can_config = {500000, OBD_REQUEST_ID, OBD_REPLY_ID, false};
+
+static DetectState state = DETECT_START;
+static CanConfigCache config_cache;
+
+static uint32_t bitrates[CAN_DETECT_CACHE_SIZE + CAN_BITRATES_SIZE];
+static unsigned bitrate_count = 0;
+static DetectProbe probes[CAN_DETECT_CACHE_SIZE + 2 * CAN_BLIND_BITRATES_SIZE];
+static unsigned probe_count = 0;
+
+// Current listen or probe step
+static unsigned cursor = 0;
+static bool step_started = false;
+static unsigned long step_ms = 0;
+static unsigned frames = 0;
+
+static unsigned long wait_ms = 0;
+static unsigned long retry_ms = CAN_DETECT_RETRY_MS;
+
+enum OpenMode {
+    OPEN_NORMAL,
+    OPEN_LISTEN_ONLY,   // never drives the bus, not even acks
+    OPEN_ONE_SHOT,      // a request that isn't acked is not retransmitted
+};
+
+static void setMode(OpenMode mode) {
+#if PLATFORM_ID == 10
+    // Carloop Rev 2 uses CAN_C4_C5, which is CAN1 on the STM32F205. Device OS
+    // has no listen-only or one-shot flag, so set bxCAN silent mode and NART
+    // directly. Both are only writable in initialization mode; the next
+    // begin() clears them again.
+    unsigned timeout = 100000;
+    CAN1->MCR |= CAN_MCR_INRQ;
+    while (!(CAN1->MSR & CAN_MSR_INAK) && --timeout);
+    if (mode == OPEN_LISTEN_ONLY) CAN1->BTR |= CAN_BTR_SILM;
+    else CAN1->BTR &= ~CAN_BTR_SILM;
+    if (mode == OPEN_ONE_SHOT) CAN1->MCR |= CAN_MCR_NART;
+    else CAN1->MCR &= ~CAN_MCR_NART;
+    CAN1->MCR &= ~CAN_MCR_INRQ;
+    timeout = 100000;
+    while ((CAN1->MSR & CAN_MSR_INAK) && --timeout);
+#endif
+}
+
+// Drops a request still pending in the transmit mailboxes
+static void abortTransmit() {
+#if PLATFORM_ID == 10
+    CAN1->TSR |= CAN_TSR_ABRQ0 | CAN_TSR_ABRQ1 | CAN_TSR_ABRQ2;
+#endif
+}
+
+static void openAt(CANChannel &can, uint32_t bitrate, OpenMode mode) {
+    can.end();
+    can.begin(bitrate);
+    if (mode != OPEN_NORMAL) setMode(mode);
+
+    CANMessage message;
+    while (can.receive(message));
+}
+
+// 0x7E8-0x7EF answer physical requests on 0x7E0-0x7E7, 0x18DAF1xx answer
+// 0x18DAxxF1. Fills config from a Mode 01 PID 0x00 reply to a probe
+static bool matchReply(const DetectProbe &probe, const CANMessage &reply, CanConfig &config) {
+    if (reply.extended != probe.extended) return false;
+    if (reply.data[1] != (0x40 | OBD_PID_SERVICE) || reply.data[2] != PIDS_SUPPORT_01_20) return false;
+
+    if (!probe.extended && reply.id >= 0x7E8 && reply.id <= 0x7EF) {
+        config.request_id = reply.id - 8;
+    } else if (probe.extended && (reply.id & 0x1FFFFF00) == 0x18DAF100) {
+        config.request_id = 0x18DA00F1 | ((reply.id & 0xFF) << 8);
+    } else {
+        return false;
+    }
+
+    config.bitrate = probe.bitrate;
+    config.reply_id = reply.id;
+    config.extended = probe.extended;
+    return true;
+}
+
+static bool sameConfig(const CanConfig &a, const CanConfig &b) {
+    return a.bitrate == b.bitrate && a.request_id == b.request_id && a.reply_id == b.reply_id && a.extended == b.extended;
+}
+
+static void loadCache(CanConfigCache &cache) {
+    EEPROM.get(CAN_DETECT_EEPROM_ADDRESS, cache);
+    if (cache.magic != CAN_CONFIG_CACHE_MAGIC || cache.count > CAN_DETECT_CACHE_SIZE) {
+        cache.magic = CAN_CONFIG_CACHE_MAGIC;
+        cache.count = 0;
+    }
+}
+
+// Most recently used first; only written when the order changes
+static void saveCache(CanConfigCache &cache, const CanConfig &config) {
+
+    if (cache.count > 0 && sameConfig(cache.configs[0], config)) return;
+
+    unsigned index = cache.count < CAN_DETECT_CACHE_SIZE ? cache.count : CAN_DETECT_CACHE_SIZE - 1;
+    for (unsigned i=0; i<cache.count; i++) {
+        if (sameConfig(cache.configs[i], config)) {
+            index = i;
+            break;
+        }
+    }
+    if (index == cache.count) cache.count++;
+
+    for (unsigned i=index; i>0; i--) cache.configs[i] = cache.configs[i - 1];
+    cache.configs[0] = config;
+
+    EEPROM.put(CAN_DETECT_EEPROM_ADDRESS, cache);
+}
+
+static void useConfig(const CanConfig &config) {
+    can_config = config;
+    obd_request_id = config.request_id;
+    obd_reply_id = config.reply_id;
+    obd_extended = config.extended;
+
+    debug_print("CAN " + String(config.bitrate / 1000) + " kbit/s, request 0x" + String(config.request_id, HEX)
+        + ", reply 0x" + String(config.reply_id, HEX) + (config.extended ? " (29-bit)" : " (11-bit)"));
+}
+
+static void addBitrate(uint32_t bitrate) {
+    for (unsigned i=0; i<bitrate_count; i++) {
+        if (bitrates[i] == bitrate) return;
+    }
+    bitrates[bitrate_count++] = bitrate;
+}
+
+static void addProbe(uint32_t bitrate, uint32_t request_id, bool extended) {
+    probes[probe_count].bitrate = bitrate;
+    probes[probe_count].request_id = request_id;
+    probes[probe_count].extended = extended;
+    probe_count++;
+}
+
+static bool blindBitrate(uint32_t bitrate) {
+    for (unsigned i=0; i<CAN_BLIND_BITRATES_SIZE; i++) {
+        if (CAN_BLIND_BITRATES[i] == bitrate) return true;
+    }
+    return false;
+}
+
+// Cached bitrates are listened to first, then the rest
+static void startRound() {
+    loadCache(config_cache);
+
+    bitrate_count = 0;
+    for (unsigned i=0; i<config_cache.count; i++) addBitrate(config_cache.configs[i].bitrate);
+    for (unsigned i=0; i<CAN_BITRATES_SIZE; i++) addBitrate(CAN_BITRATES[i]);
+
+    cursor = 0;
+    step_started = false;
+    state = DETECT_LISTEN;
+}
+
+// Only where traffic was heard, or on the usual OBD bitrates if the bus is silent
+// (OBD behind a gateway): cached configurations first, then functional requests
+static void startProbes(uint32_t heard) {
+    probe_count = 0;
+    for (unsigned i=0; i<config_cache.count; i++) {
+        const CanConfig &cached = config_cache.configs[i];
+        if (heard ? cached.bitrate == heard : blindBitrate(cached.bitrate)) addProbe(cached.bitrate, cached.request_id, cached.extended);
+    }
+    for (unsigned i=0; i<CAN_BLIND_BITRATES_SIZE; i++) {
+        uint32_t bitrate = heard ? heard : CAN_BLIND_BITRATES[i];
+        addProbe(bitrate, OBD_FUNCTIONAL_ID, false);
+        addProbe(bitrate, OBD_EXT_FUNCTIONAL_ID, true);
+        if (heard) break;
+    }
+
+    if (heard) debug_print("CAN traffic at " + String(heard / 1000) + " kbit/s");
+    cursor = 0;
+    step_started = false;
+    state = DETECT_PROBE;
+}
+
+// Nothing answered (car off?): stay on the last known configuration and try
+// again later, less often each time
+static void failRound(CANChannel &can) {
+    openAt(can, can_config.bitrate, OPEN_NORMAL);
+    wait_ms = retry_ms;
+    retry_ms = retry_ms * 2 < CAN_DETECT_MAX_RETRY_MS ? retry_ms * 2 : CAN_DETECT_MAX_RETRY_MS;
+    step_ms = millis();
+    state = DETECT_WAIT;
+    debug_print("CAN detection failed, retry in " + String(wait_ms / 1000) + " s");
+}
+
+// A wrong bitrate never yields a frame with a valid CRC
+static void listenStep(CANChannel &can) {
+
+    if (!step_started) {
+        openAt(can, bitrates[cursor], OPEN_LISTEN_ONLY);
+        frames = 0;
+        step_ms = millis();
+        step_started = true;
+        return;
+    }
+
+    CANMessage message;
+    while (can.receive(message)) {
+        if (++frames >= CAN_DETECT_MIN_FRAMES) {
+            startProbes(bitrates[cursor]);
+            return;
+        }
+    }
+
+    if (millis() - step_ms < CAN_DETECT_LISTEN_MS) return;
+
+    step_started = false;
+    if (++cursor == bitrate_count) startProbes(0);
+}
+
+// Sends Mode 01 PID 0x00 one-shot. An error (wrong bitrate, no ack) ends the
+// probe at once instead of flooding the bus with error frames until it times out
+static bool probeStep(CANChannel &can) {
+
+    const DetectProbe &probe = probes[cursor];
+
+    if (!step_started) {
+        openAt(can, probe.bitrate, OPEN_ONE_SHOT);
+
+        CANMessage message;
+        message.id = probe.request_id;
+        message.extended = probe.extended;
+        message.len = 8;
+        buildObdRequest(message.data, PIDS_SUPPORT_01_20);
+        step_started = can.transmit(message);
+        step_ms = millis();
+        if (step_started) return false;
+    }
+
+    bool failed = !step_started || can.errorStatus() != CAN_NO_ERROR;
+    if (failed) abortTransmit();
+
+    CANMessage reply;
+    CanConfig found;
+    while (!failed && can.receive(reply)) {
+        if (!matchReply(probe, reply, found)) continue;
+
+        useConfig(found);
+        saveCache(config_cache, found);
+        openAt(can, found.bitrate, OPEN_NORMAL);
+        recordTimeToReady();
+        retry_ms = CAN_DETECT_RETRY_MS;
+        state = DETECT_DONE;
+        return true;
+    }
+
+    if (!failed && millis() - step_ms < CAN_DETECT_PROBE_MS) return false;
+
+    step_started = false;
+    if (++cursor == probe_count) failRound(can);
+    return false;
+}
+
+bool detectCanConfigLoop(CANChannel &can) {
+
+    switch (state) {
+        case DETECT_START:
+            startRound();
+            return false;
+
+        case DETECT_LISTEN:
+            listenStep(can);
+            return false;
+
+        case DETECT_PROBE:
+            return probeStep(can);
+
+        case DETECT_WAIT:
+            if (millis() - step_ms >= wait_ms) state = DETECT_START;
+            return false;
+
+        case DETECT_DONE:
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Particle.h"
+
+// CAN bitrate and OBD addressing detection for the Electron.
+//
+// 1. Bitrates are opened listen-only, those of configurations cached in EEPROM
+//    from earlier drives first, and accepted once broadcast frames decode
+//    cleanly. Nothing is transmitted at a bitrate that wasn't heard.
+// 2. On that bitrate the cached configurations are tried with a physical
+//    Mode 01 PID 0x00 request, so a known car is ready after one round trip.
+// 3. Then a functional Mode 01 PID 0x00 request is sent with 11-bit (0x7DF)
+//    and 29-bit (0x18DB33F1) addressing; the first ECU to answer becomes the
+//    physical request/reply pair used by the poller.
+//
+// A silent bus (OBD behind a gateway) is probed at 500 and 250 kbit/s only.
+// Probes go out one-shot and stop at the first bus error. Detection runs one
+// step per call, so loop() keeps serving Serial4 and the sleep pin; failed
+// rounds are retried after CAN_DETECT_RETRY_MS, doubling up to
+// CAN_DETECT_MAX_RETRY_MS.
+
+#define CAN_DETECT_LISTEN_MS 150
+#define CAN_DETECT_MIN_FRAMES 2
+#define CAN_DETECT_PROBE_MS 100
+#define CAN_DETECT_RETRY_MS 5000
+#define CAN_DETECT_MAX_RETRY_MS 60000
+#define CAN_DETECT_CACHE_SIZE 4
+#define CAN_DETECT_EEPROM_ADDRESS 0
+
+struct CanConfig {
+    uint32_t bitrate;
+    uint32_t request_id;
+    uint32_t reply_id;
+    bool extended;
+};
+
+extern CanConfig can_config;
+
+// Advances detection by one step. Returns true once can is open at the
+// detected configuration and the poller points at it
+bool detectCanConfigLoop(CANChannel &can);
@@ -5,12 +5,18 @@
 #include <ArduinoJson.h>
 #include "obd2.h"
 #include "helper.h"
+#include "obd_poller.h"
+#include "burst.h"
+#include "aggregate.h"
+#include "subscription.h"
+#include "can_detect.h"
+#include "periodic.h"
+#include "signals.h"
 #include "Serial4/Serial4.h"
 
 #define FF_LOCATOR_ENABLED false
 #define FF_DEBUG_PRINT false
 #define FF_SNIFF_MODE false
-#define SUPPORT_PID_REQUEST_PERIOD_SECONDS 30
 
 // DeviceID: 4f002f000550483553353520
 
@@ -18,14 +24,11 @@
 void debug_print(String msg) {
     if (FF_DEBUG_PRINT) Serial.println(msg);
 }
-void resetOBDSupportData();
-void setReadSupportPIDsLoop(bool override = false);
-int sendObdRequest();
+int sendObdRequest(int request_pid);
 void getObdResponse(int request_pid);
-void storeMessageValue(byte data[8]);
-void setPidEnabled(uint8_t pid);
+void transmitObdFrame(uint8_t data[8]);
+void receiveFrames();
 void receiveSendPIDsLoop();
-String dataToJsonStr();
 void sniff_loop();
 
 // System
@@ -37,19 +40,8 @@ Locator locator;
 // carloop
 Carloop<CarloopRevision2> carloop;
 
-const auto OBD_REQUEST_ID      = 0x7E0;
-const auto OBD_REPLY_ID        = 0x7E8;
-const auto OBD_PID_SERVICE     = 0x01;
-
-// obd data
-float alldata[PID_SIZE];
-uint8_t *send_pids;
-unsigned send_pid_size;
-bool send_all_pids;
-bool pid_enabled[PID_SIZE];
-bool can_ready = false;
-
 int current_gear = 0;
+bool can_detected = false;
 
 // algorithms
 void doCustomAlgorithms() {
@@ -82,9 +74,15 @@ void loop() {
     receiveSendPIDsLoop();
     setReadSupportPIDsLoop();
 
+    // Find bitrate and addressing before polling, one step per loop
+    if (!can_detected) can_detected = detectCanConfigLoop(carloop.can());
+
     // carloop
+    // Regular requests every 100ms, burst capture PIDs back-to-back in between
     static auto loop_delay = millis();
-    if (millis() - loop_delay > 100) {
+    bool poll_due = millis() - loop_delay > 100;
+    // Held back while a periodic data definition is split over two frames
+    if (can_detected && !periodicBusy() && (poll_due || (can_ready && burstArmed()))) {
 
         if (carloop.can().errorStatus() != CAN_NO_ERROR) {
 
@@ -102,21 +100,34 @@ void loop() {
             can_ready = true;
 
             carloop.update();
-            int currentPid = sendObdRequest();
+            int currentPid = sendObdRequest(poll_due ? nextObdRequestPid() : burstNextPid());
             getObdResponse(currentPid);
             doCustomAlgorithms();
         }
-        loop_delay = millis();
+        if (poll_due) loop_delay = millis();
+    }
+
+    // Periodic data negotiation and keep-alive; pushed and broadcast frames are read between polls too
+    if (can_detected) {
+        uint8_t frame[8];
+        while (periodicNextFrame(frame)) transmitObdFrame(frame);
+        if (periodicRunning() || signal_count) receiveFrames();
     }
 
-    // print results through Serial4
-    static auto print_delay = millis();
-    if (millis() - print_delay > 1000) {
-        String jsonString = dataToJsonStr();
+    // Frozen bursts go out a chunk at a time between the regular reports
+    burstLoop();
+    String burstString;
+    if (burstNextChunk(burstString)) {
+        Serial4.println(burstString);
+        debug_print("Sending burst: " + burstString);
+    }
+
+    // print results through Serial4, one line per due subscription
+    String jsonString;
+    while (subscriptionNextReport(jsonString)) {
         Serial4.println(jsonString);
         debug_print("Sending JSON: " + jsonString);
         Serial4.flush();
-        print_delay = millis();
     }
 
     // Sleep when car off
@@ -145,130 +156,58 @@ void loop() {
     }
 }
 
-void resetOBDSupportData() {
+int sendObdRequest(int request_pid) {
 
-    send_pids = NULL;
-    send_all_pids = true;
+    uint8_t data[8];
+    buildObdRequest(data, request_pid);
+    transmitObdFrame(data);
 
-    // init arrays
-    for (unsigned i = 0; i < PID_SIZE; i++) {
-      alldata[i] = EMPTY_VALUE;
-      pid_enabled[i] = false;
-    }
-
-    setReadSupportPIDsLoop();
-}
-
-void setReadSupportPIDsLoop(bool override) {
-
-    static auto wait = millis();
-    if (millis() - wait < SUPPORT_PID_REQUEST_PERIOD_SECONDS * 1000 && !override) return;
-
-    // Enable Read Supported PIDs
-    for (unsigned i=0; i<PID_SUPPORT_PIDS_SIZE; i++) {
-        pid_enabled[PID_SUPPORT_PIDS[i]] = true;
-    }
-
-    wait = millis();
+    return request_pid;
 }
 
-int sendObdRequest() {
-
-    // This is not accurate
-    static int currentPidIndex = 0;
-
-    int request_pid = currentPidIndex;
-    currentPidIndex = getNextPID(currentPidIndex, send_all_pids, send_pids, send_pid_size);
-
-    // Only query PIDs that are supported
-    if (send_all_pids) {
-        while (!pid_enabled[currentPidIndex]) {
-            currentPidIndex = getNextPID(currentPidIndex, send_all_pids, send_pids);
-        }
-    }
-
-    debug_print("Request PID: " + String(request_pid));
+void transmitObdFrame(uint8_t data[8]) {
 
     CANMessage message;
-    message.id = OBD_REQUEST_ID;
+    message.id = obd_request_id;
+    message.extended = obd_extended;
     message.len = 8;
-    message.data[0] = 0x02;
-    message.data[1] = OBD_PID_SERVICE;
-    message.data[2] = request_pid;
+    for (unsigned i=0; i<8; i++) message.data[i] = data[i];
     carloop.can().transmit(message);
-
-    return request_pid;
 }
 
 void getObdResponse(int request_pid) {
     CANMessage message;
 
+    // Only fresh frames: periodic data must not be stored twice
     auto delay_time = millis();
-    bool message_delayed = true;
-    while (carloop.can().receive(message) || message_delayed) {
-
-        if (millis() - delay_time > 50) {
-            message_delayed = false;
-        }
+    while (millis() - delay_time <= 50) {
 
-        if (message.id != OBD_REPLY_ID) continue;
+        if (!carloop.can().receive(message)) continue;
 
-        // If we find exactly what we are asking for
-        if (message.data[2] == request_pid) {
-            storeMessageValue(message.data);
-            break;
+        if (message.id != obd_reply_id || message.extended != obd_extended) {
+            signalsDecode(message.id, message.extended, message.data, message.len);
+            continue;
         }
 
-        // Not quite what we asked for but useful. Keep looking
-        for (unsigned i=0; i<PID_SIZE; i++) {
-            if (message.data[2] >= PID_SIZE) break;
+        if (periodicHandleFrame(message.data)) continue;
 
-            if (pid_enabled[message.data[2]]) {
-                storeMessageValue(message.data);
-                break;
-            }
-        }
+        if (handleObdReply(request_pid, message.data)) break;
     }
 }
 
-void storeMessageValue(byte data[8]) {
-
-    uint8_t pid = data[2];
+// Drains the receive queue so pushed and broadcast frames don't overflow it between polls
+void receiveFrames() {
+    CANMessage message;
 
-    uint8_t values[4] = {data[3], data[4], data[5], data[6]};
-    alldata[pid] = getPidValue(pid, values);
+    while (carloop.can().receive(message)) {
 
-    // Set PIDs to Query, turn off the flag
-    
-    for (unsigned i=0; i<PID_SUPPORT_PIDS_SIZE; i++) {
-        if (pid >= PID_SIZE) continue;
-        if (pid == PID_SUPPORT_PIDS[i]) {
-            setPidEnabled(pid);
-            pid_enabled[pid] = false;
-            break;
+        if (message.id != obd_reply_id || message.extended != obd_extended) {
+            signalsDecode(message.id, message.extended, message.data, message.len);
+            continue;
         }
-    }
-
-    debug_print("Store PID " + String(pid) + " Value: " + alldata[pid]);
-}
-
-void setPidEnabled(uint8_t pid) {
-    
-    if (pid >= PID_SIZE) return;
 
-    uint32_t mask = (uint32_t)alldata[pid];
-
-    unsigned shift = 0;
-    if (pid == PIDS_SUPPORT_01_20) shift = 0x00;
-    if (pid == PIDS_SUPPORT_21_40) shift = 0x20;
-    if (pid == PIDS_SUPPORT_41_60) shift = 0x40;
-
-    
-    for (int i=0; i<0x20; i++) {
-        unsigned index = (0x20 - i + shift);
-        if (index >= PID_SIZE) continue;
-        pid_enabled[index] = (mask & (1<<i)) != 0;
-        if (pid_enabled[index]) debug_print("Support PID: " + String(index));
+        // Late Mode 01 replies, getObdResponse() has given up on them
+        if (!periodicHandleFrame(message.data)) handleObdReply(-1, message.data);
     }
 }
 
@@ -293,93 +232,59 @@ void receiveSendPIDsLoop() {
         return;
     }
 
-    unsigned count = json["count"] | 0;
-    if (count <= 0) {
+    if (!json["burst"].isNull()) {
+        burstConfigure(json["burst"].as<JsonObject>());
         return;
     }
 
-    if (send_pids != NULL) delete []send_pids;
-    send_pids = NULL;
-
-    int all = json["all"] | -1;
-    debug_print("All: " + String(all));
-    if (all) {
-        send_pid_size = 0;
-        send_all_pids = true;
+    if (!json["periodic"].isNull()) {
+        periodicConfigure(json["periodic"].as<JsonObject>());
         return;
     }
 
-    if (all != 0) return;
-
-    send_pids = new uint8_t[count];
-    unsigned actual_count = count;
-
-    for (unsigned i=0; i<count; i++) {
-        uint8_t _send_pid = json["pids"][i] | 0xFF;
-        if (_send_pid == 0xFF) {
-            actual_count--;
-            continue;
-        }
-        send_pids[i] = _send_pid;
-        debug_print("Send PID index " + String(i) + " value: " + send_pids[i]);
+    if (!json["sig"].isNull()) {
+        signalsConfigure(json["sig"].as<JsonObject>());
+        return;
     }
 
-    send_pid_size = count;
-    send_all_pids = false;
-
-    // { "count": 2, "all": 0, "pids": [13, 14] }
-    debug_print("Send PIDs count = " + String(count));
-}
-
-String dataToJsonStr() {
-    DynamicJsonDocument json(4096);
-    String output;
-
-    json["cr"] = can_ready;
-    json["a"] = unsigned(send_all_pids);
-
-    if (!can_ready) {
-        serializeJson(json, output);
-        return output;
+    if (!json["sub"].isNull()) {
+        subscriptionConfigure(json["sub"].as<JsonObject>());
+        return;
     }
 
-    unsigned count = 0;
-
-    if (send_all_pids) {
-        for (unsigned i=0; i<PID_SIZE; i++) {
-            if (alldata[i] == EMPTY_VALUE) continue;
-            if (fToStr(alldata[i]) == EMPTY_STRING) continue;
-
-            // { "car_ready": true, "count": 2, "metrics": [ { "pid": 12, "name": "eng", "value": "2504", "unit": "RPM" }, { "pid": 13, "name": "spd", "value": "105", "unit": "km/h" } ] }
-            json["m"][count]["pid"] = i;
-            json["m"][count]["n"] = getPidName(i);
-            json["m"][count]["v"] = fToStr(alldata[i]);
-            json["m"][count]["u"] = getPidUnits(i);
-
-            count++;
-        }
-    } else {
-        for (unsigned i=0; i<send_pid_size; i++) {
+    // { "agg": 1 } adds min/max/mean/stddev since the last report to every metric
+    if (!json["agg"].isNull()) {
+        aggregate_mode = json["agg"] | 0;
+        aggregateResetAll();
+        debug_print("Aggregate mode: " + String(aggregate_mode));
+    }
 
-            //debug_print("Composing PID: " + send_pids[i]);
+    unsigned count = json["count"] | 0;
+    if (count <= 0) {
+        return;
+    }
 
-            if (alldata[send_pids[i]] == EMPTY_VALUE) continue;
-            if (fToStr(alldata[send_pids[i]]) == EMPTY_STRING) continue;
+    int all = json["all"] | -1;
+    debug_print("All: " + String(all));
+    if (all) {
+        setDefaultSubscription(true, NULL, 0);
+        return;
+    }
 
-            // { "car_ready": true, "count": 2, "metrics": [ { "pid": 12, "name": "eng", "value": "2504", "unit": "RPM" }, { "pid": 13, "name": "spd", "value": "105", "unit": "km/h" } ] }
-            json["m"][count]["pid"] = send_pids[i];
-            //json["metrics"][count]["n"] = getPidName(i);
-            json["m"][count]["v"] = fToStr(alldata[send_pids[i]]);
-            json["m"][count]["u"] = getPidUnits(send_pids[i]);
+    uint8_t pids[PID_SIZE];
+    unsigned actual_count = 0;
 
-            count++;
-        }
+    for (unsigned i=0; i<count && actual_count < PID_SIZE; i++) {
+        unsigned _send_pid = json["pids"][i] | 0xFF;
+        if (_send_pid >= PID_SIZE) continue;
+        pids[actual_count++] = _send_pid;
+        debug_print("Send PID index " + String(i) + " value: " + _send_pid);
     }
 
-    json["c"] = count;
+    if (!setDefaultSubscription(false, pids, actual_count)) return;
 
-    serializeJson(json, output);
-    return output;
+    // { "count": 2, "all": 0, "pids": [13, 14] }
+    debug_print("Send PIDs count = " + String(actual_count));
 }
 
 void sniff_loop() {
@@ -5,6 +5,8 @@
 #include <ArduinoJson.h>
 
 // Utilities
+// LED and PMIC control only exist on the device; the Linux gateway links the rest of this file
+#ifdef PLATFORM_ID
 void setLEDTheme(bool ready) {
     LEDSystemTheme theme;
     if (ready) theme.setColor(LED_SIGNAL_NETWORK_OFF, RGB_COLOR_GREEN);
@@ -52,6 +54,7 @@ void setCharging(bool enable) {
 	Wire3.endTransmission(true);
 
 }
+#endif
 
 bool isWithinNumberRange(float number, int A, int B) {
     if (number >= A && number <= B) {
@@ -108,8 +111,8 @@ int getNextPID(int currentPid, bool all, uint8_t *send_pids, unsigned send_pid_s
 
     current_send_pid_index++;
 
-    // Support PID after last send_pids index
-    if (current_send_pid_index == send_pid_size) {
+    // Support PID after last send_pids index (or the list shrank underneath us)
+    if (current_send_pid_index >= send_pid_size) {
         current_send_pid_index = 0;
         return PID_SUPPORT_PIDS[0];
     }
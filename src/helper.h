@@ -1,6 +1,8 @@
+#pragma once
+
 #include "Particle.h"
 
-#define EMPTY_VALUE -100.1
+#define EMPTY_VALUE -100.1f
 #define EMPTY_STRING fToStr(EMPTY_VALUE)
 
 void setLEDTheme(bool ready);
@@ -44,7 +44,14 @@ String getPidUnits(uint8_t pid) {
 #endif
 }
 
-float getPidValue(uint8_t pid, uint8_t value[4]) {
+// Reports through length how many of A-D a formula reads, so the byte count
+// of a PID can't drift from its formula
+static float consumed(uint8_t *length, uint8_t bytes, float value) {
+  if (length) *length = bytes;
+  return value;
+}
+
+float getPidValue(uint8_t pid, uint8_t value[4], uint8_t *length) {
   uint8_t A = value[0];
   uint8_t B = value[1];
   uint8_t C = value[2];
@@ -59,7 +66,7 @@ float getPidValue(uint8_t pid, uint8_t value[4]) {
     case PIDS_SUPPORT_41_60: // raw
     case MONITOR_STATUS_THIS_DRIVE_CYCLE: // raw
       // NOTE: return value can lose precision!
-      return ((uint32_t)A << 24 | (uint32_t)B << 16 | (uint32_t)C << 8 | (uint32_t)D);
+      return consumed(length, 4, ((uint32_t)A << 24 | (uint32_t)B << 16 | (uint32_t)C << 8 | (uint32_t)D));
 
     case FUEL_SYSTEM_STATUS: // raw
     case RUN_TIME_SINCE_ENGINE_START:
@@ -67,7 +74,7 @@ float getPidValue(uint8_t pid, uint8_t value[4]) {
     case DISTANCE_TRAVELED_SINCE_CODES_CLEARED:
     case TIME_RUN_WITH_MIL_ON:
     case TIME_SINCE_TROUBLE_CODES_CLEARED:
-      return (A * 256.0 + B);
+      return consumed(length, 2, (A * 256.0 + B));
 
     case CALCULATED_ENGINE_LOAD:
     case THROTTLE_POSITION:
@@ -84,7 +91,7 @@ float getPidValue(uint8_t pid, uint8_t value[4]) {
     case ETHANOL_FUEL_PERCENTAGE:
     case RELATIVE_ACCELERATOR_PEDAL_POSITTION:
     case HYBRID_BATTERY_PACK_REMAINING_LIFE:
-      return (A / 2.55);
+      return consumed(length, 1, (A / 2.55));
 
     case COMMANDED_SECONDARY_AIR_STATUS: // raw
     case OBD_STANDARDS_THIS_VEHICLE_CONFORMS_TO: // raw
@@ -93,7 +100,7 @@ float getPidValue(uint8_t pid, uint8_t value[4]) {
     case AUXILIARY_INPUT_STATUS: // raw
     case FUEL_TYPE: // raw
     case EMISSION_REQUIREMENT_TO_WHICH_VEHICLE_IS_DESIGNED: // raw
-      return (A);
+      return consumed(length, 1, (A));
 
     case OXYGEN_SENSOR_1_SHORT_TERM_FUEL_TRIM:
     case OXYGEN_SENSOR_2_SHORT_TERM_FUEL_TRIM:
@@ -103,46 +110,46 @@ float getPidValue(uint8_t pid, uint8_t value[4]) {
     case OXYGEN_SENSOR_6_SHORT_TERM_FUEL_TRIM:
     case OXYGEN_SENSOR_7_SHORT_TERM_FUEL_TRIM:
     case OXYGEN_SENSOR_8_SHORT_TERM_FUEL_TRIM:
-      return ((B / 1.28) - 100.0);
+      return consumed(length, 2, ((B / 1.28) - 100.0));
       break;
 
     case ENGINE_COOLANT_TEMPERATURE:
     case AIR_INTAKE_TEMPERATURE:
     case AMBIENT_AIR_TEMPERATURE:
     case ENGINE_OIL_TEMPERATURE:
-      return (A - 40.0);
+      return consumed(length, 1, (A - 40.0));
 
     case SHORT_TERM_FUEL_TRIM_BANK_1:
     case LONG_TERM_FUEL_TRIM_BANK_1:
     case SHORT_TERM_FUEL_TRIM_BANK_2:
     case LONG_TERM_FUEL_TRIM_BANK_2:
     case EGR_ERROR:
-      return ((A / 1.28) - 100.0);
+      return consumed(length, 1, ((A / 1.28) - 100.0));
 
     case FUEL_PRESSURE:
-      return (A * 3.0);
+      return consumed(length, 1, (A * 3.0));
 
     case INTAKE_MANIFOLD_ABSOLUTE_PRESSURE:
     case VEHICLE_SPEED:
     case WARM_UPS_SINCE_CODES_CLEARED:
     case ABSOLULTE_BAROMETRIC_PRESSURE:
-      return (A);
+      return consumed(length, 1, (A));
 
     case ENGINE_RPM:
-      return ((A * 256.0 + B) / 4.0);
+      return consumed(length, 2, ((A * 256.0 + B) / 4.0));
 
     case TIMING_ADVANCE:
-      return ((A / 2.0) - 64.0);
+      return consumed(length, 1, ((A / 2.0) - 64.0));
 
     case MAF_AIR_FLOW_RATE:
-      return ((A * 256.0 + B) / 100.0);
+      return consumed(length, 2, ((A * 256.0 + B) / 100.0));
 
     case FUEL_RAIL_PRESSURE:
-      return ((A * 256.0 + B) * 0.079);
+      return consumed(length, 2, ((A * 256.0 + B) * 0.079));
 
     case FUEL_RAIL_GAUGE_PRESSURE:
     case FUEL_RAIL_ABSOLUTE_PRESSURE:
-      return ((A * 256.0 + B) * 10.0);
+      return consumed(length, 2, ((A * 256.0 + B) * 10.0));
 
     case OXYGEN_SENSOR_1_FUEL_AIR_EQUIVALENCE_RATIO:
     case OXYGEN_SENSOR_2_FUEL_AIR_EQUIVALENCE_RATIO:
@@ -160,36 +167,52 @@ float getPidValue(uint8_t pid, uint8_t value[4]) {
     case 0x39:
     case 0x3a:
     case 0x3b:
-      return (((A * 256.0 + B) * 2.0) / 65536.0);
+      return consumed(length, 2, (((A * 256.0 + B) * 2.0) / 65536.0));
 
     case EVAP_SYSTEM_VAPOR_PRESSURE:
-      return (((int16_t)(A * 256.0 + B)) / 4.0);
+      return consumed(length, 2, (((int16_t)(A * 256.0 + B)) / 4.0));
 
     case CATALYST_TEMPERATURE_BANK_1_SENSOR_1:
     case CATALYST_TEMPERATURE_BANK_2_SENSOR_1:
     case CATALYST_TEMPERATURE_BANK_1_SENSOR_2:
     case CATALYST_TEMPERATURE_BANK_2_SENSOR_2:
-      return (((A * 256.0 + B) / 10.0) - 40.0);
+      return consumed(length, 2, (((A * 256.0 + B) / 10.0) - 40.0));
 
     case CONTROL_MODULE_VOLTAGE:
-      return ((A * 256.0 + B) / 1000.0);
+      return consumed(length, 2, ((A * 256.0 + B) / 1000.0));
 
     case ABSOLUTE_LOAD_VALUE:
-      return ((A * 256.0 + B) / 2.55);
+      return consumed(length, 2, ((A * 256.0 + B) / 2.55));
 
     case FUEL_AIR_COMMANDED_EQUIVALENCE_RATE:
-      return (2.0 * (A * 256.0 + B) / 65536.0);
+      return consumed(length, 2, (2.0 * (A * 256.0 + B) / 65536.0));
 
     case ABSOLUTE_EVAP_SYSTEM_VAPOR_PRESSURE:
-      return ((A * 256.0 + B) / 200.0);
+      return consumed(length, 2, ((A * 256.0 + B) / 200.0));
 
     case 0x54:
-      return ((A * 256.0 + B) - 32767.0);
+      return consumed(length, 2, ((A * 256.0 + B) - 32767.0));
 
     case FUEL_INJECTION_TIMING:
-      return (((A * 256.0 + B) / 128.0) - 210.0);
+      return consumed(length, 2, (((A * 256.0 + B) / 128.0) - 210.0));
 
     case ENGINE_FUEL_RATE:
-      return ((A * 256.0 + B) / 20.0);
+      return consumed(length, 2, ((A * 256.0 + B) / 20.0));
+  }
+}
+
+// Bytes of the reply that getPidValue() reads (A = 1, A-B = 2, A-D = 4)
+uint8_t getPidDataLength(uint8_t pid) {
+  uint8_t value[4] = {0, 0, 0, 0};
+  uint8_t length;
+  getPidValue(pid, value, &length);
+  return length;
+}
+
+// PIDs 0x00, 0x20 and 0x40 are bitmaps of the supported PIDs, not measurements
+bool isSupportPid(uint8_t pid) {
+  for (unsigned i=0; i<PID_SUPPORT_PIDS_SIZE; i++) {
+    if (pid == PID_SUPPORT_PIDS[i]) return true;
   }
-}
\ No newline at end of file
+  return false;
+}
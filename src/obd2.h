@@ -1,3 +1,5 @@
+#pragma once
+
 #include "Particle.h"
 #include <math.h>
 
@@ -11,7 +13,9 @@
 
 String getPidName(uint8_t pid);
 String getPidUnits(uint8_t pid);
-float getPidValue(uint8_t pid, uint8_t value[4]);
+float getPidValue(uint8_t pid, uint8_t value[4], uint8_t *length = NULL);
+uint8_t getPidDataLength(uint8_t pid);
+bool isSupportPid(uint8_t pid);
 
 // Sourced from https://github.com/sandeepmistry/arduino-OBD2/blob/master/src/OBD2.h
 
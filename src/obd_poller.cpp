@@ -0,0 +1,259 @@
+#include "obd_poller.h"
+#include "helper.h"
+#include "burst.h"
+#include "aggregate.h"
+#include "subscription.h"
+#include "periodic.h"
+#include "signals.h"
+#include <Arduino.h>
+#define ARDUINOJSON_ENABLE_PROGMEM 0
+#include <ArduinoJson.h>
+
+uint32_t obd_request_id = OBD_REQUEST_ID;
+uint32_t obd_reply_id = OBD_REPLY_ID;
+bool obd_extended = false;
+
+// obd data
+float alldata[PID_SIZE];
+uint8_t *send_pids = NULL;
+unsigned send_pid_size = 0;
+bool send_all_pids = true;
+bool aggregate_mode = false;
+bool pid_enabled[PID_SIZE];
+bool can_ready = false;
+
+// Time from start (boot or wake on the Electron) to the first valid reply, 0 until then
+unsigned long time_to_ready_ms = 0;
+static unsigned long obd_start_ms = 0;
+
+void resetOBDSupportData() {
+
+    obd_start_ms = millis();
+    time_to_ready_ms = 0;
+
+    subscriptionsReset();
+
+    // init arrays
+    for (unsigned i = 0; i < PID_SIZE; i++) {
+      alldata[i] = EMPTY_VALUE;
+      pid_enabled[i] = false;
+    }
+
+    setReadSupportPIDsLoop();
+}
+
+void setReadSupportPIDsLoop(bool override) {
+
+    static auto wait = millis();
+    if (millis() - wait < SUPPORT_PID_REQUEST_PERIOD_SECONDS * 1000 && !override) return;
+
+    // Enable Read Supported PIDs
+    for (unsigned i=0; i<PID_SUPPORT_PIDS_SIZE; i++) {
+        pid_enabled[PID_SUPPORT_PIDS[i]] = true;
+    }
+
+    wait = millis();
+}
+
+// Returns the PID to request now and advances the schedule
+int nextObdRequestPid() {
+
+    // This is not accurate
+    static int currentPidIndex = 0;
+
+    int request_pid = currentPidIndex;
+
+    // Skip PIDs the ECU pushes on its own and, when sending all, unsupported ones.
+    // One round of the schedule at most: with everything pushed or disabled the
+    // support PIDs are polled instead
+    bool found = false;
+    for (unsigned n=0; n<PID_SIZE + PID_SUPPORT_PIDS_SIZE && !found; n++) {
+        currentPidIndex = getNextPID(currentPidIndex, send_all_pids, send_pids, send_pid_size);
+        found = !pid_periodic[currentPidIndex] && (!send_all_pids || pid_enabled[currentPidIndex]);
+    }
+    if (!found) currentPidIndex = PID_SUPPORT_PIDS[0];
+
+    debug_print("Request PID: " + String(request_pid));
+
+    return request_pid;
+}
+
+void buildObdRequest(uint8_t data[8], int request_pid) {
+    for (unsigned i=0; i<8; i++) data[i] = 0;
+    data[0] = 0x02;
+    data[1] = OBD_PID_SERVICE;
+    data[2] = request_pid;
+}
+
+// First valid reply since start, from the poller or the CAN detection probe
+void recordTimeToReady() {
+    if (time_to_ready_ms) return;
+
+    time_to_ready_ms = millis() - obd_start_ms;
+    if (!time_to_ready_ms) time_to_ready_ms = 1;
+    debug_print("First valid reply after " + String(time_to_ready_ms) + " ms");
+}
+
+// Stores a Mode 01 reply from obd_reply_id. Returns true if it answers request_pid;
+// replies for other enabled PIDs (late ones, after the next request went out) are
+// stored too. Anything else on the reply id (UDS responses, flow control) is ignored
+bool handleObdReply(int request_pid, uint8_t data[8]) {
+
+    // Pushed periodic frames belong to periodicHandleFrame()
+    uint8_t pid;
+    float value;
+    uint32_t raw;
+    if (data[0] >= PERIODIC_PDID_BASE || !decodeObdFrame(data, pid, value, &raw)) return false;
+
+    recordTimeToReady();
+
+    // Not quite what we asked for but useful
+    if (pid != request_pid && !pid_enabled[pid]) return false;
+
+    storeMessageValue(pid, value, raw);
+
+    // Set PIDs to Query, turn off the flag
+    for (unsigned i=0; i<PID_SUPPORT_PIDS_SIZE; i++) {
+        if (pid == PID_SUPPORT_PIDS[i]) {
+            // Raw bitmap: the float value drops the low bits
+            setPidEnabled(pid, raw);
+            pid_enabled[pid] = false;
+            break;
+        }
+    }
+
+    return pid == request_pid;
+}
+
+// PID and value of a Mode 01 reply or a pushed periodic frame, without storing
+// anything. Shared by the device path and the offline log decoder, so it must
+// stay free of globals. raw gets the data bytes the PID uses as one word, A
+// in the top byte (PID 1: A = bits 31-24, D = bits 7-0)
+bool decodeObdFrame(const uint8_t data[8], uint8_t &pid, float &value, uint32_t *raw) {
+
+    uint8_t values[4];
+    if (data[0] >= PERIODIC_PDID_BASE) {
+        pid = data[0] - PERIODIC_PDID_BASE;
+        for (unsigned i=0; i<4; i++) values[i] = data[1 + i];
+    } else if (data[0] >= 3 && data[0] <= 7 && data[1] == (0x40 | OBD_PID_SERVICE)) {
+        pid = data[2];
+        for (unsigned i=0; i<4; i++) values[i] = data[3 + i];
+    } else {
+        return false;
+    }
+
+    if (pid >= PID_SIZE) return false;
+    uint8_t length;
+    value = getPidValue(pid, values, &length);
+
+    if (raw) {
+        *raw = 0;
+        for (unsigned i=0; i<length; i++) *raw = (*raw << 8) | values[i];
+    }
+    return true;
+}
+
+// A decoded value, from a reply or pushed by the ECU, with its raw data bytes
+void storeMessageValue(uint8_t pid, float value, uint32_t raw) {
+
+    alldata[pid] = value;
+    burstSample(pid, value, raw);
+    if (aggregate_mode && !isSupportPid(pid)) aggregateSample(pid, value);
+
+    debug_print("Store PID " + String(pid) + " Value: " + alldata[pid]);
+}
+
+void setPidEnabled(uint8_t pid, uint32_t mask) {
+
+    if (pid >= PID_SIZE) return;
+
+    unsigned shift = 0;
+    if (pid == PIDS_SUPPORT_01_20) shift = 0x00;
+    if (pid == PIDS_SUPPORT_21_40) shift = 0x20;
+    if (pid == PIDS_SUPPORT_41_60) shift = 0x40;
+
+
+    for (int i=0; i<0x20; i++) {
+        unsigned index = (0x20 - i + shift);
+        if (index >= PID_SIZE) continue;
+        pid_enabled[index] = (mask & (1UL<<i)) != 0;
+        if (pid_enabled[index]) debug_print("Support PID: " + String(index));
+    }
+}
+
+// { "c": 9, "mn": "2480", "mx": "3125", "av": "2761.5", "sd": "201.3" }
+static void addAggregateJson(JsonVariant metric, uint8_t pid) {
+    const PidAggregate &aggregate = aggregates[pid];
+    if (aggregate.count == 0) return;
+
+    metric["s"]["c"] = aggregate.count;
+    metric["s"]["mn"] = fToStr(aggregate.min);
+    metric["s"]["mx"] = fToStr(aggregate.max);
+    metric["s"]["av"] = fToStr(aggregate.mean);
+    metric["s"]["sd"] = fToStr(aggregateStddev(aggregate));
+}
+
+String dataToJsonStr(const Subscription &subscription) {
+
+    // Aggregate windows follow the default report period
+    bool with_aggregates = aggregate_mode && &subscription == &DEFAULT_SUBSCRIPTION;
+
+    // Broadcast signals cost nothing to collect, they go wherever all PIDs would
+    bool with_signals = signal_count && (subscription.all || &subscription == &DEFAULT_SUBSCRIPTION);
+
+    DynamicJsonDocument json((with_aggregates ? 8192 : 4096) + (with_signals ? 2048 : 0));
+    String output;
+
+    json["cr"] = can_ready;
+    json["t"] = millis();
+    if (subscription.name[0]) json["id"] = subscription.name;
+    json["a"] = unsigned(subscription.all);
+    if (with_aggregates) json["ag"] = 1;
+    if (time_to_ready_ms && &subscription == &DEFAULT_SUBSCRIPTION) json["ttr"] = time_to_ready_ms;
+
+    if (!can_ready) {
+        serializeJson(json, output);
+
+        // Nothing was reported, but the next window starts now all the same
+        if (with_aggregates) aggregateResetAll();
+        return output;
+    }
+
+    unsigned count = 0;
+    unsigned size = subscription.all ? PID_SIZE : subscription.pid_count;
+
+    for (unsigned i=0; i<size; i++) {
+        uint8_t pid = subscription.all ? i : subscription.pids[i];
+
+        if (alldata[pid] == EMPTY_VALUE) continue;
+        if (fToStr(alldata[pid]) == EMPTY_STRING) continue;
+
+        // { "car_ready": true, "count": 2, "metrics": [ { "pid": 12, "name": "eng", "value": "2504", "unit": "RPM" }, { "pid": 13, "name": "spd", "value": "105", "unit": "km/h" } ] }
+        json["m"][count]["pid"] = pid;
+        if (subscription.format == FORMAT_FULL) json["m"][count]["n"] = getPidName(pid);
+        json["m"][count]["v"] = fToStr(alldata[pid]);
+        json["m"][count]["u"] = getPidUnits(pid);
+        if (with_aggregates) addAggregateJson(json["m"][count], pid);
+
+        count++;
+    }
+
+    for (unsigned i=0; with_signals && i<signal_count; i++) {
+        if (!signalFresh(signals[i])) continue;
+
+        json["m"][count]["sig"] = signals[i].name;
+        json["m"][count]["v"] = fToStr(signals[i].value);
+        json["m"][count]["u"] = signals[i].unit;
+
+        count++;
+    }
+
+    json["c"] = count;
+
+    serializeJson(json, output);
+
+    // Next report starts a fresh window
+    if (with_aggregates) aggregateResetAll();
+
+    return output;
+}
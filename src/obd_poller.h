@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Particle.h"
+#include "obd2.h"
+
+#define SUPPORT_PID_REQUEST_PERIOD_SECONDS 30
+
+const auto OBD_REQUEST_ID      = 0x7E0;
+const auto OBD_REPLY_ID        = 0x7E8;
+const auto OBD_PID_SERVICE     = 0x01;
+
+// Functional (broadcast) request ids, answered by every emissions ECU
+const auto OBD_FUNCTIONAL_ID       = 0x7DF;
+const auto OBD_EXT_FUNCTIONAL_ID   = 0x18DB33F1;
+
+// Addressing in use, OBD_REQUEST_ID / OBD_REPLY_ID until detected otherwise
+extern uint32_t obd_request_id;
+extern uint32_t obd_reply_id;
+extern bool obd_extended;
+
+struct Subscription;
+
+// obd data (shared between the Electron sketch and the Linux gateway)
+extern float alldata[PID_SIZE];
+extern uint8_t *send_pids;
+extern unsigned send_pid_size;
+extern bool send_all_pids;
+extern bool aggregate_mode;
+extern bool pid_enabled[PID_SIZE];
+extern bool can_ready;
+extern unsigned long time_to_ready_ms;
+
+// Implemented by the application (Serial on the Electron, stderr on Linux)
+void debug_print(String msg);
+
+void resetOBDSupportData();
+void setReadSupportPIDsLoop(bool override = false);
+int nextObdRequestPid();
+void buildObdRequest(uint8_t data[8], int request_pid);
+void recordTimeToReady();
+bool handleObdReply(int request_pid, uint8_t data[8]);
+bool decodeObdFrame(const uint8_t data[8], uint8_t &pid, float &value, uint32_t *raw = NULL);
+void storeMessageValue(uint8_t pid, float value, uint32_t raw);
+void setPidEnabled(uint8_t pid, uint32_t mask);
+String dataToJsonStr(const Subscription &subscription);
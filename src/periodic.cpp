@@ -0,0 +1,319 @@
+#include "periodic.h"
+#include "obd_poller.h"
+
+#define UDS_SESSION_CONTROL 0x10
+#define UDS_DEFINE_DID 0x2C
+#define UDS_READ_PERIODIC 0x2A
+#define UDS_TESTER_PRESENT 0x3E
+#define UDS_NEGATIVE_RESPONSE 0x7F
+#define UDS_RESPONSE_PENDING 0x78
+
+// A single frame 2A request carries up to 5 periodic identifiers
+#define PERIODIC_START_BATCH 5
+
+enum PeriodicState {
+    STATE_IDLE,
+    STATE_SESSION,      // 10 03
+    STATE_DEFINE,       // 2C 01 first frame, waiting for flow control
+    STATE_DEFINE_CF,    // 2C 01 consecutive frame
+    STATE_START,        // 2A rate pdid...
+    STATE_ACTIVE,       // ECU pushing, 3E 80 every few seconds
+    STATE_STOP,         // 10 01 still to send
+    STATE_REFUSED,      // polling again, retried after PERIODIC_RETRY_MS
+};
+
+bool pid_periodic[PID_SIZE];
+
+static PeriodicState state = STATE_IDLE;
+static uint8_t pids[PERIODIC_MAX_PIDS];
+static bool defined[PERIODIC_MAX_PIDS];
+static unsigned pid_count = 0;
+static uint8_t rate = PERIODIC_FAST;
+
+// Define / start cursor into pids
+static unsigned cursor = 0;
+static uint8_t batch[PERIODIC_START_BATCH];
+static unsigned batch_count = 0;
+
+// Outstanding request
+static bool waiting = false;
+static unsigned long sent_ms = 0;
+static unsigned long wait_ms = 0;
+
+static unsigned long last_tester_ms = 0;
+static unsigned long last_data_ms = 0;
+
+static void clearPeriodicPids() {
+    for (unsigned i=0; i<PID_SIZE; i++) pid_periodic[i] = false;
+}
+
+static void startNegotiation() {
+    clearPeriodicPids();
+    for (unsigned i=0; i<pid_count; i++) defined[i] = false;
+    cursor = 0;
+    waiting = false;
+    state = STATE_SESSION;
+}
+
+static void refuse(String reason) {
+    clearPeriodicPids();
+    waiting = false;
+    sent_ms = millis();
+    state = STATE_REFUSED;
+    debug_print("Periodic data: " + reason + ", polling instead");
+}
+
+static bool moreToStart() {
+    for (unsigned i=cursor; i<pid_count; i++) {
+        if (defined[i]) return true;
+    }
+    return false;
+}
+
+static void finishStart() {
+
+    unsigned active = 0;
+    for (unsigned i=0; i<pid_count; i++) {
+        if (pid_periodic[pids[i]]) active++;
+    }
+
+    if (!active) {
+        refuse("start refused");
+        return;
+    }
+
+    state = STATE_ACTIVE;
+    last_tester_ms = millis();
+    last_data_ms = millis();
+    debug_print("Periodic data: " + String(active) + " of " + String(pid_count) + " PIDs pushed by the ECU");
+}
+
+static void defineDone(bool accepted) {
+
+    defined[cursor] = accepted;
+    if (!accepted) debug_print("Periodic data: PID " + String(pids[cursor]) + " refused");
+
+    if (++cursor < pid_count) {
+        state = STATE_DEFINE;
+        return;
+    }
+
+    cursor = 0;
+    state = STATE_START;
+    if (!moreToStart()) refuse("no periodic DID defined");
+}
+
+bool periodicConfigure(JsonObject config) {
+
+    bool was_running = state != STATE_IDLE && state != STATE_REFUSED;
+
+    pid_count = 0;
+    for (unsigned i=0; i<config["pids"].size() && pid_count < PERIODIC_MAX_PIDS; i++) {
+        unsigned pid = config["pids"][i] | 0xFF;
+        if (pid >= PID_SIZE) continue;
+
+        // Support bitmaps keep being polled, they drive discovery
+        bool support_pid = false;
+        for (unsigned j=0; j<PID_SUPPORT_PIDS_SIZE; j++) {
+            if ((int)pid == PID_SUPPORT_PIDS[j]) support_pid = true;
+        }
+        if (!support_pid) pids[pid_count++] = pid;
+    }
+
+    const char *rate_name = config["rate"] | "fast";
+    rate = !strcmp(rate_name, "slow") ? PERIODIC_SLOW : !strcmp(rate_name, "medium") ? PERIODIC_MEDIUM : PERIODIC_FAST;
+
+    if (pid_count == 0) {
+        clearPeriodicPids();
+        waiting = false;
+
+        // Leaving the extended session stops the ECU's periodic scheduler
+        state = was_running ? STATE_STOP : STATE_IDLE;
+        return true;
+    }
+
+    startNegotiation();
+    debug_print("Periodic data: negotiating " + String(pid_count) + " PIDs");
+    return true;
+}
+
+bool periodicRunning() {
+    return state != STATE_IDLE && state != STATE_REFUSED;
+}
+
+// True from the 2C first frame until its consecutive frame is sent. No Mode 01
+// request may go out between them, the ECU would abort the ISO-TP reception
+bool periodicBusy() {
+    return (state == STATE_DEFINE && waiting) || (state == STATE_DEFINE_CF && !waiting);
+}
+
+// Next negotiation or keep-alive frame for obd_request_id, if one is due
+bool periodicNextFrame(uint8_t data[8]) {
+
+    if (state == STATE_IDLE) return false;
+
+    if (state == STATE_REFUSED) {
+        if (pid_count == 0 || !can_ready || millis() - sent_ms < PERIODIC_RETRY_MS) return false;
+        startNegotiation();
+    }
+
+    if (waiting) {
+        if (millis() - sent_ms >= wait_ms) refuse("no response");
+        return false;
+    }
+
+    if (state == STATE_ACTIVE) {
+        if (millis() - last_data_ms > PERIODIC_STALE_MS) {
+            refuse("ECU stopped sending");
+            return false;
+        }
+        if (millis() - last_tester_ms < PERIODIC_TESTER_PRESENT_MS) return false;
+    }
+
+    for (unsigned i=0; i<8; i++) data[i] = 0;
+
+    switch (state) {
+        case STATE_SESSION:
+            data[0] = 0x02;
+            data[1] = UDS_SESSION_CONTROL;
+            data[2] = 0x03;
+            break;
+
+        // defineByIdentifier 0xF2xx <- 0xF400+pid, position 1, getPidDataLength() bytes:
+        // 8 bytes, so a first frame now and a consecutive frame after flow control
+        case STATE_DEFINE:
+            data[0] = 0x10;
+            data[1] = 0x08;
+            data[2] = UDS_DEFINE_DID;
+            data[3] = 0x01;
+            data[4] = 0xF2;
+            data[5] = PERIODIC_PDID_BASE + pids[cursor];
+            data[6] = 0xF4;
+            data[7] = pids[cursor];
+            break;
+
+        case STATE_DEFINE_CF:
+            data[0] = 0x21;
+            data[1] = 0x01;
+            data[2] = getPidDataLength(pids[cursor]);
+            break;
+
+        case STATE_START:
+            batch_count = 0;
+            while (cursor < pid_count && batch_count < PERIODIC_START_BATCH) {
+                if (defined[cursor]) batch[batch_count++] = pids[cursor];
+                cursor++;
+            }
+            data[0] = 2 + batch_count;
+            data[1] = UDS_READ_PERIODIC;
+            data[2] = rate;
+            for (unsigned i=0; i<batch_count; i++) data[3 + i] = PERIODIC_PDID_BASE + batch[i];
+            break;
+
+        // suppressPosRspMsgIndicationBit set, nothing comes back
+        case STATE_ACTIVE:
+            data[0] = 0x02;
+            data[1] = UDS_TESTER_PRESENT;
+            data[2] = 0x80;
+            last_tester_ms = millis();
+            return true;
+
+        case STATE_STOP:
+            data[0] = 0x02;
+            data[1] = UDS_SESSION_CONTROL;
+            data[2] = 0x01;
+            state = STATE_IDLE;
+            return true;
+
+        default:
+            return false;
+    }
+
+    waiting = true;
+    sent_ms = millis();
+    wait_ms = PERIODIC_RESPONSE_MS;
+    return true;
+}
+
+static uint8_t expectedService() {
+    switch (state) {
+        case STATE_SESSION: return UDS_SESSION_CONTROL;
+        case STATE_DEFINE:
+        case STATE_DEFINE_CF: return UDS_DEFINE_DID;
+        case STATE_START: return UDS_READ_PERIODIC;
+        default: return 0;
+    }
+}
+
+// Returns true if the frame from obd_reply_id was periodic data or a negotiation reply
+bool periodicHandleFrame(uint8_t data[8]) {
+
+    // Pushed data: [80+pid, A, B, C, D], decoded and stored like a Mode 01 reply
+    if (data[0] >= PERIODIC_PDID_BASE) {
+        uint8_t pid;
+        float value;
+        uint32_t raw;
+
+        // Late frames after a stop or refusal are dropped, the PID is polled again
+        if (!decodeObdFrame(data, pid, value, &raw) || !pid_periodic[pid]) return true;
+
+        storeMessageValue(pid, value, raw);
+        last_data_ms = millis();
+        return true;
+    }
+
+    if (!waiting) return false;
+
+    // ISO-TP flow control for the 2C first frame
+    if ((data[0] & 0xF0) == 0x30) {
+        if (state != STATE_DEFINE) return true;
+
+        switch (data[0] & 0x0F) {
+            case 0x00:
+                waiting = false;
+                state = STATE_DEFINE_CF;
+                break;
+            case 0x01:
+                sent_ms = millis();
+                break;
+            default:
+                waiting = false;
+                defineDone(false);
+                break;
+        }
+        return true;
+    }
+
+    bool negative = data[1] == UDS_NEGATIVE_RESPONSE;
+    uint8_t service = negative ? data[2] : data[1] - 0x40;
+    if (service != expectedService()) return false;
+
+    if (negative && data[3] == UDS_RESPONSE_PENDING) {
+        sent_ms = millis();
+        wait_ms = PERIODIC_PENDING_MS;
+        return true;
+    }
+
+    waiting = false;
+
+    switch (state) {
+        case STATE_SESSION:
+            if (negative) refuse("extended session refused");
+            else state = STATE_DEFINE;
+            break;
+
+        case STATE_DEFINE:
+        case STATE_DEFINE_CF:
+            defineDone(!negative);
+            break;
+
+        case STATE_START:
+            for (unsigned i=0; i<batch_count; i++) pid_periodic[batch[i]] = !negative;
+            if (!moreToStart()) finishStart();
+            break;
+
+        default:
+            break;
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Particle.h"
+#include "obd2.h"
+#define ARDUINOJSON_ENABLE_PROGMEM 0
+#include <ArduinoJson.h>
+
+// ECU-pushed data with UDS ReadDataByPeriodicIdentifier (0x2A), so high-rate
+// PIDs stop costing one request each.
+//
+// 1. Extended diagnostic session (10 03).
+// 2. Each PID is defined as periodic DID 0xF2(80+pid) copying its OBD DID
+//    0xF400+pid (2C 01, two-frame ISO-TP request).
+// 3. The defined ones are started at the requested rate (2A 01/02/03).
+// 4. Tester present (3E 80) keeps the session open.
+//
+// The ECU then sends [80+pid, A, B, ...] frames on obd_reply_id on its own;
+// the 0x80 offset keeps them apart from ISO-TP frames (PCI 0x0-0x3). They are
+// stored like Mode 01 replies and the PIDs drop out of the poll schedule. PIDs
+// the ECU refuses stay polled; if it refuses everything, or the pushed frames
+// stop, all of them go back to polling and negotiation is retried later.
+//
+// { "periodic": { "pids": [12, 13, 17], "rate": "fast" } }
+// { "periodic": { "pids": [] } } stops and returns to the default session.
+//
+// Frames to send are pulled with periodicNextFrame() and go to obd_request_id;
+// every frame from obd_reply_id is offered to periodicHandleFrame() first.
+
+#define PERIODIC_MAX_PIDS 8
+#define PERIODIC_PDID_BASE 0x80
+#define PERIODIC_RESPONSE_MS 200
+#define PERIODIC_PENDING_MS 5000
+#define PERIODIC_TESTER_PRESENT_MS 2000
+#define PERIODIC_STALE_MS 3000
+#define PERIODIC_RETRY_MS 30000
+
+enum PeriodicRate {
+    PERIODIC_SLOW = 0x01,
+    PERIODIC_MEDIUM = 0x02,
+    PERIODIC_FAST = 0x03,
+};
+
+// PIDs currently pushed by the ECU, skipped by nextObdRequestPid()
+extern bool pid_periodic[PID_SIZE];
+
+bool periodicConfigure(JsonObject config);
+bool periodicRunning();
+bool periodicBusy();
+bool periodicNextFrame(uint8_t data[8]);
+bool periodicHandleFrame(uint8_t data[8]);
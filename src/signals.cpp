@@ -0,0 +1,167 @@
+#include "signals.h"
+#include "obd_poller.h"
+#include "helper.h"
+
+CanSignal signals[SIGNAL_MAX];
+unsigned signal_count = 0;
+
+// First signal of each frame id, -1 = empty slot
+static int8_t table_first[SIGNAL_TABLE_SIZE];
+static uint32_t table_key[SIGNAL_TABLE_SIZE];
+static bool table_ready = false;
+
+static uint32_t signalKey(uint32_t id, bool extended) {
+    return (id & 0x1FFFFFFF) | (extended ? 0x80000000 : 0);
+}
+
+static unsigned tableSlot(uint32_t key) {
+    // Fibonacci hashing onto the 6-bit table index
+    unsigned slot = (uint32_t)(key * 2654435761u) >> 26;
+    while (table_first[slot] >= 0 && table_key[slot] != key) slot = (slot + 1) & (SIGNAL_TABLE_SIZE - 1);
+    return slot;
+}
+
+void signalsClear() {
+    signal_count = 0;
+    for (unsigned i=0; i<SIGNAL_TABLE_SIZE; i++) table_first[i] = -1;
+    table_ready = true;
+}
+
+// Bit positions follow DBC: Intel signals start at their LSB, counted from
+// bit 0 of byte 0 upwards; Motorola signals start at their MSB, counted
+// 7..0 in byte 0, 15..8 in byte 1 and so on
+static bool addSignal(JsonObject definition) {
+
+    if (signal_count >= SIGNAL_MAX) {
+        debug_print("Signal table full");
+        return false;
+    }
+
+    CanSignal &signal = signals[signal_count];
+    signal.id = definition["can"] | 0xFFFFFFFF;
+    signal.extended = definition["x"] | 0;
+    signal.big_endian = definition["be"] | 0;
+    signal.is_signed = definition["sg"] | 0;
+    signal.scale = definition["sc"] | 1.0;
+    signal.offset = definition["of"] | 0.0;
+    signal.value = EMPTY_VALUE;
+    signal.updated_ms = 0;
+
+    unsigned start = definition["sb"] | 0;
+    unsigned length = definition["len"] | 0;
+    if (signal.id > 0x1FFFFFFF || (!signal.extended && signal.id > 0x7FF)) return false;
+    if (start > 63 || length == 0 || length > 32) return false;
+
+    if (signal.big_endian) {
+        // Position from the first transmitted bit, where the 64-bit word is big-endian
+        unsigned msb = (start / 8) * 8 + (7 - start % 8);
+        unsigned lsb = msb + length - 1;
+        if (lsb > 63) return false;
+        signal.shift = 63 - lsb;
+        signal.min_len = lsb / 8 + 1;
+    } else {
+        if (start + length > 64) return false;
+        signal.shift = start;
+        signal.min_len = (start + length - 1) / 8 + 1;
+    }
+    signal.length = length;
+
+    const char *name = definition["n"] | "";
+    const char *unit = definition["u"] | "";
+    strncpy(signal.name, name, SIGNAL_NAME_SIZE - 1);
+    signal.name[SIGNAL_NAME_SIZE - 1] = 0;
+    strncpy(signal.unit, unit, SIGNAL_UNIT_SIZE - 1);
+    signal.unit[SIGNAL_UNIT_SIZE - 1] = 0;
+
+    // Chain onto the frame's slot
+    uint32_t key = signalKey(signal.id, signal.extended);
+    unsigned slot = tableSlot(key);
+    signal.next = table_first[slot];
+    table_first[slot] = signal_count;
+    table_key[slot] = key;
+
+    signal_count++;
+    return true;
+}
+
+bool signalsConfigure(JsonObject config) {
+
+    if (!table_ready || (config["clr"] | 0)) signalsClear();
+
+    unsigned size = config["add"].size();
+    unsigned added = 0;
+    for (unsigned i=0; i<size; i++) {
+        JsonObject definition = config["add"][i].as<JsonObject>();
+        if (addSignal(definition)) added++;
+        else debug_print("Invalid signal " + String(definition["n"] | ""));
+    }
+
+    debug_print("Signals: " + String(signal_count) + " (" + String(added) + " added)");
+    return added == size;
+}
+
+// First signal carried by a frame id, -1 if none. Read-only, so the offline
+// decoder can share the table between threads
+int signalFirst(uint32_t id, bool extended) {
+    if (!signal_count) return -1;
+    return table_first[tableSlot(signalKey(id, extended))];
+}
+
+// The frame as a 64-bit word both ways round, shared by all its signals
+void signalFrameWords(const uint8_t *data, uint8_t len, uint64_t &little, uint64_t &big) {
+    little = 0;
+    big = 0;
+    for (unsigned i=0; i<8; i++) {
+        uint8_t byte = i < len ? data[i] : 0;
+        little |= (uint64_t)byte << (8 * i);
+        big = (big << 8) | byte;
+    }
+}
+
+float signalValue(const CanSignal &signal, uint64_t little, uint64_t big) {
+
+    uint32_t mask = signal.length == 32 ? 0xFFFFFFFF : (1UL << signal.length) - 1;
+    uint32_t raw = ((signal.big_endian ? big : little) >> signal.shift) & mask;
+
+    if (signal.is_signed && (raw >> (signal.length - 1)) & 1) {
+        return (int32_t)(raw | ~mask) * signal.scale + signal.offset;
+    }
+    return raw * signal.scale + signal.offset;
+}
+
+// Called for every received frame. Returns true if the id carries signals
+bool signalsDecode(uint32_t id, bool extended, const uint8_t *data, uint8_t len) {
+
+    int index = signalFirst(id, extended);
+    if (index < 0) return false;
+
+    uint64_t little, big;
+    signalFrameWords(data, len, little, big);
+
+    for (; index >= 0; index = signals[index].next) {
+        CanSignal &signal = signals[index];
+        if (len < signal.min_len) continue;
+
+        signal.value = signalValue(signal, little, big);
+        signal.updated_ms = millis();
+    }
+    return true;
+}
+
+// Broadcasts stop with the ignition; old values are left out of reports
+bool signalFresh(const CanSignal &signal) {
+    return signal.value != EMPTY_VALUE && millis() - signal.updated_ms < SIGNAL_STALE_MS;
+}
+
+// Distinct frame ids with signals, for receive filters
+unsigned signalIds(uint32_t *ids, bool *extended, unsigned max) {
+
+    unsigned count = 0;
+    for (unsigned slot=0; slot<SIGNAL_TABLE_SIZE && count < max; slot++) {
+        if (!table_ready || table_first[slot] < 0) continue;
+        ids[count] = table_key[slot] & 0x1FFFFFFF;
+        extended[count] = table_key[slot] & 0x80000000;
+        count++;
+    }
+    return count;
+}
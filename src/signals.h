@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Particle.h"
+#define ARDUINOJSON_ENABLE_PROGMEM 0
+#include <ArduinoJson.h>
+
+// Passive decoding of the car's own broadcast frames. Speed, RPM or pedal
+// position are usually sent at 50-100 Hz on the normal CAN traffic, so with a
+// signal definition they cost no requests at all. Definitions follow DBC
+// semantics and are loaded at runtime through the control channel:
+//
+// { "sig": { "clr": 1, "add": [
+//     { "can": 513, "n": "rpm", "sb": 7, "len": 16, "be": 1, "sc": 0.25, "u": "rpm" },
+//     { "can": 208, "n": "steer", "sb": 0, "len": 16, "sg": 1, "sc": 0.1, "of": 0, "u": "deg" } ] } }
+//
+// "can" is the frame id ("x": 1 for 29-bit), "sb" the DBC start bit (LSB for
+// Intel, MSB for Motorola "be": 1), "sg": 1 for signed. Definitions without
+// "clr" are added to the loaded ones.
+//
+// Frames are looked up by id in an open addressing table, so the cost per
+// received frame is one probe plus a shift and mask per signal on it. Fresh
+// values are reported next to the OBD PIDs as { "sig": "rpm", "v": "2100", "u": "rpm" }.
+
+#define SIGNAL_MAX 32
+#define SIGNAL_NAME_SIZE 12
+#define SIGNAL_UNIT_SIZE 8
+#define SIGNAL_TABLE_SIZE 64 // power of 2, at least twice SIGNAL_MAX
+#define SIGNAL_STALE_MS 2000
+
+struct CanSignal {
+    char name[SIGNAL_NAME_SIZE];
+    char unit[SIGNAL_UNIT_SIZE];
+    uint32_t id;
+    bool extended;
+    bool is_signed;
+    bool big_endian;
+    uint8_t length;
+    uint8_t shift;      // right shift of the frame as a 64-bit word
+    uint8_t min_len;    // bytes the frame needs to carry the signal
+    float scale;
+    float offset;
+    float value;
+    unsigned long updated_ms;
+    int8_t next;        // next signal in the same frame, -1 ends
+};
+
+extern CanSignal signals[SIGNAL_MAX];
+extern unsigned signal_count;
+
+bool signalsConfigure(JsonObject config);
+void signalsClear();
+bool signalsDecode(uint32_t id, bool extended, const uint8_t *data, uint8_t len);
+int signalFirst(uint32_t id, bool extended);
+void signalFrameWords(const uint8_t *data, uint8_t len, uint64_t &little, uint64_t &big);
+float signalValue(const CanSignal &signal, uint64_t little, uint64_t big);
+bool signalFresh(const CanSignal &signal);
+unsigned signalIds(uint32_t *ids, bool *extended, unsigned max);
@@ -0,0 +1,167 @@
+#include "subscription.h"
+#include "obd_poller.h"
+
+Subscription subscriptions[SUBSCRIPTION_MAX];
+
+// Union of all subscriptions, handed to getNextPID() through send_pids
+static uint8_t scheduled_pids[PID_SIZE];
+
+static unsigned report_cursor = 0;
+
+void subscriptionsReset() {
+
+    for (unsigned i=0; i<SUBSCRIPTION_MAX; i++) {
+        subscriptions[i].name[0] = 0;
+        subscriptions[i].active = false;
+        subscriptions[i].pid_count = 0;
+    }
+
+    DEFAULT_SUBSCRIPTION.active = true;
+    DEFAULT_SUBSCRIPTION.period_ms = 1000;
+    DEFAULT_SUBSCRIPTION.last_report_ms = millis();
+    setDefaultSubscription(true, NULL, 0);
+}
+
+// False, leaving the subscription as it was, when no valid PID is left
+static bool setPids(Subscription &subscription, bool all, const uint8_t *pids, unsigned count) {
+
+    uint8_t valid[PID_SIZE];
+    unsigned valid_count = 0;
+    for (unsigned i=0; !all && i<count && valid_count < PID_SIZE; i++) {
+        if (pids[i] >= PID_SIZE) continue;
+        valid[valid_count++] = pids[i];
+    }
+    if (!all && valid_count == 0) return false;
+
+    subscription.all = all;
+    subscription.pid_count = valid_count;
+    memcpy(subscription.pids, valid, valid_count);
+    return true;
+}
+
+// The legacy control message: names are only sent with all PIDs, as before
+bool setDefaultSubscription(bool all, const uint8_t *pids, unsigned count) {
+    if (!setPids(DEFAULT_SUBSCRIPTION, all, pids, count)) {
+        debug_print("No valid PIDs, report unchanged");
+        return false;
+    }
+    DEFAULT_SUBSCRIPTION.format = all ? FORMAT_FULL : FORMAT_SHORT;
+    subscriptionsSchedule();
+    return true;
+}
+
+static Subscription *findSubscription(const char *name, bool create) {
+
+    Subscription *free_slot = NULL;
+    for (unsigned i=1; i<SUBSCRIPTION_MAX; i++) {
+        if (subscriptions[i].active && !strcmp(subscriptions[i].name, name)) return &subscriptions[i];
+        if (!subscriptions[i].active && !free_slot) free_slot = &subscriptions[i];
+    }
+
+    if (!create || !free_slot) return NULL;
+
+    strncpy(free_slot->name, name, SUBSCRIPTION_NAME_SIZE - 1);
+    free_slot->name[SUBSCRIPTION_NAME_SIZE - 1] = 0;
+    return free_slot;
+}
+
+bool subscriptionConfigure(JsonObject config) {
+
+    const char *name = config["id"] | "";
+    if (name[0] == 0) return false;
+
+    if (config["del"] | 0) {
+        Subscription *subscription = findSubscription(name, false);
+        if (subscription) subscription->active = false;
+        subscriptionsSchedule();
+        return subscription != NULL;
+    }
+
+    Subscription *subscription = findSubscription(name, true);
+    if (!subscription) {
+        debug_print("No free subscription for " + String(name));
+        return false;
+    }
+
+    uint8_t pids[PID_SIZE];
+    unsigned count = 0;
+    for (unsigned i=0; i<config["pids"].size() && count < PID_SIZE; i++) {
+        unsigned pid = config["pids"][i] | 0xFF;
+        if (pid >= PID_SIZE) continue;
+        pids[count++] = pid;
+    }
+
+    // Without "all" there has to be at least one valid PID, [] or [300] is an error
+    if (!setPids(*subscription, config["all"] | 0, pids, count)) {
+        debug_print("Subscription " + String(name) + " has no valid PIDs");
+        return false;
+    }
+
+    const char *format = config["fmt"] | "full";
+    subscription->format = strcmp(format, "short") ? FORMAT_FULL : FORMAT_SHORT;
+
+    unsigned period = config["ms"] | 1000;
+    subscription->period_ms = period < SUBSCRIPTION_MIN_PERIOD_MS ? SUBSCRIPTION_MIN_PERIOD_MS : period;
+    subscription->last_report_ms = millis();
+    subscription->active = true;
+
+    subscriptionsSchedule();
+    debug_print("Subscription " + String(name) + " PIDs: " + String(subscription->pid_count));
+    return true;
+}
+
+// Recomputes the poll schedule: every PID wanted by anyone, each requested once
+void subscriptionsSchedule() {
+
+    bool wanted[PID_SIZE];
+    bool all = false;
+    for (unsigned i=0; i<PID_SIZE; i++) wanted[i] = false;
+
+    for (unsigned i=0; i<SUBSCRIPTION_MAX; i++) {
+        if (!subscriptions[i].active) continue;
+        if (subscriptions[i].all) all = true;
+        for (unsigned j=0; j<subscriptions[i].pid_count; j++) wanted[subscriptions[i].pids[j]] = true;
+    }
+
+    unsigned count = 0;
+    if (!all) {
+        for (unsigned pid=0; pid<PID_SIZE; pid++) {
+            if (wanted[pid]) scheduled_pids[count++] = pid;
+        }
+    }
+
+    send_pids = count ? scheduled_pids : NULL;
+    send_pid_size = count;
+    send_all_pids = count == 0;
+}
+
+// Returns the report of the next subscription that is due, one per call
+bool subscriptionNextReport(String &output) {
+
+    for (unsigned n=0; n<SUBSCRIPTION_MAX; n++) {
+        unsigned i = (report_cursor + n) % SUBSCRIPTION_MAX;
+        Subscription &subscription = subscriptions[i];
+        if (!subscription.active) continue;
+        if (millis() - subscription.last_report_ms <= subscription.period_ms) continue;
+
+        output = dataToJsonStr(subscription);
+        subscription.last_report_ms = millis();
+        report_cursor = i + 1;
+        return true;
+    }
+
+    return false;
+}
+
+// Milliseconds until the next subscription is due
+unsigned long subscriptionNextDueMs() {
+
+    unsigned long next = 0xFFFFFFFF;
+    for (unsigned i=0; i<SUBSCRIPTION_MAX; i++) {
+        if (!subscriptions[i].active) continue;
+        unsigned long elapsed = millis() - subscriptions[i].last_report_ms;
+        unsigned long due = elapsed > subscriptions[i].period_ms ? 0 : subscriptions[i].period_ms + 1 - elapsed;
+        if (due < next) next = due;
+    }
+    return next;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Particle.h"
+#include "obd2.h"
+#define ARDUINOJSON_ENABLE_PROGMEM 0
+#include <ArduinoJson.h>
+
+// Named report subscriptions sharing one poll schedule. The poller requests the
+// union of every subscription's PIDs once; each subscription is then served
+// from alldata at its own period and format, so a new consumer costs output
+// bandwidth only.
+//
+// Slot 0 is the default report configured by { "count": 2, "all": 0, "pids": [13, 14] }.
+// Named ones are added, changed and removed with
+// { "sub": { "id": "dash", "pids": [12, 13], "ms": 200, "fmt": "short" } }
+// { "sub": { "id": "log", "all": 1, "ms": 5000 } }
+// { "sub": { "id": "dash", "del": 1 } }
+// Without "all", "pids" must name at least one PID below PID_SIZE; an empty or
+// all-invalid list is rejected and leaves the subscription unchanged.
+//
+// "ms" is a report period only. Polling walks the union round-robin, so each
+// PID is refreshed about once per pass over the union: a 200 ms "dash" next to
+// an "all" logger repeats the same values until the pass comes round again.
+
+#define SUBSCRIPTION_MAX 4
+#define SUBSCRIPTION_NAME_SIZE 12
+#define SUBSCRIPTION_MIN_PERIOD_MS 100
+
+enum SubscriptionFormat {
+    FORMAT_FULL,    // pid, name, value, units
+    FORMAT_SHORT,   // pid, value, units
+};
+
+struct Subscription {
+    char name[SUBSCRIPTION_NAME_SIZE];
+    bool active;
+    bool all;
+    uint8_t pids[PID_SIZE];
+    unsigned pid_count;
+    uint8_t format;
+    unsigned period_ms;
+    unsigned long last_report_ms;
+};
+
+extern Subscription subscriptions[SUBSCRIPTION_MAX];
+#define DEFAULT_SUBSCRIPTION subscriptions[0]
+
+void subscriptionsReset();
+bool setDefaultSubscription(bool all, const uint8_t *pids, unsigned count);
+bool subscriptionConfigure(JsonObject config);
+void subscriptionsSchedule();
+bool subscriptionNextReport(String &output);
+unsigned long subscriptionNextDueMs();